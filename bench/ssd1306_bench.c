@@ -0,0 +1,356 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Micro-benchmarks for rendering and packing hot paths. Display is
+ * emulated by in-memory transport so numbers reflect CPU cost only.
+ * Output is one line per benchmark: name, ns/op, bytes/frame (0 where
+ * transfer size makes no sense) and ops/s, separated by tabs. For the
+ * frame benchmarks ops/s is frames per second.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ssd1306.h"
+#include "tmp102.h"
+#include "inky_pack.h"
+
+#define	INKY_WIDTH	104
+#define	INKY_HEIGHT	212
+
+static int iterations = 1000;
+static volatile int sink;
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "%s: [-n iterations] [-m model]\n", prog);
+	fprintf(stderr, "\t-n iterations\tbase iteration count (default 1000)\n");
+	fprintf(stderr, "\t-m model\tSSD1306 model: 0 - 96x16, 1 - 128x32, "
+	    "2 - 128x64 (default 2)\n");
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+report(const char *name, uint64_t start, uint64_t end, int ops,
+    uint64_t bytes)
+{
+	double ns;
+
+	ns = (double)(end - start) / ops;
+	printf("%s\t%.1f\t%llu\t%.0f\n", name, ns,
+	    (unsigned long long)(bytes / ops), 1000000000.0 / ns);
+}
+
+static uint64_t
+bytes_sent(ssd1306_handle_t h)
+{
+	struct ssd1306_stats stats;
+
+	ssd1306_get_stats(h, &stats);
+	return (stats.bytes);
+}
+
+/*
+ * Byte-per-pixel to page format conversion the library used to do on
+ * every refresh, kept for comparison
+ */
+static void
+legacy_convert(const uint8_t *screen, uint8_t *scratch, int width,
+    int height, int rotate)
+{
+	int x, y;
+	int sx, sy;
+	uint8_t *page;
+	int bit;
+
+	memset(scratch, 0, width * height / 8);
+	for (x = 0; x < width; x++) {
+		for (y = 0; y < height; y++) {
+			if (rotate) {
+				sx = width - x - 1;
+				sy = height - y - 1;
+			} else {
+				sx = x;
+				sy = y;
+			}
+			page = scratch + ((sy / 8) * width + sx);
+			bit = sy % 8;
+			if (screen[y * width + x])
+				*page |= (1 << bit);
+			else
+				*page &= ~(1 << bit);
+		}
+	}
+}
+
+static void
+bench_legacy(int width, int height)
+{
+	uint8_t *screen, *scratch;
+	uint64_t start;
+	int i;
+
+	screen = malloc(width * height);
+	scratch = malloc(width * height / 8);
+	if ((screen == NULL) || (scratch == NULL))
+		goto out;
+	for (i = 0; i < width * height; i++)
+		screen[i] = random() & 1;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		legacy_convert(screen, scratch, width, height, i & 1);
+		sink += scratch[i % (width * height / 8)];
+	}
+	report("legacy_convert", start, now_ns(), iterations,
+	    (uint64_t)iterations * width * height / 8);
+out:
+	free(screen);
+	free(scratch);
+}
+
+/*
+ * Whole frame changes every time: conversion plus full transfer
+ */
+static void
+bench_refresh_full(ssd1306_handle_t h, const char *name)
+{
+	uint64_t start, bytes;
+	int i, width, height;
+
+	width = ssd1306_width(h);
+	height = ssd1306_height(h);
+	bytes = bytes_sent(h);
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		ssd1306_fill_rect(h, 0, 0, width, height, i & 1);
+		ssd1306_refresh(h);
+	}
+	report(name, start, now_ns(), iterations, bytes_sent(h) - bytes);
+}
+
+/*
+ * Nothing changed since last refresh
+ */
+static void
+bench_refresh_idle(ssd1306_handle_t h)
+{
+	uint64_t start, bytes;
+	int i;
+
+	ssd1306_refresh(h);
+	bytes = bytes_sent(h);
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		ssd1306_refresh(h);
+	report("refresh_idle", start, now_ns(), iterations,
+	    bytes_sent(h) - bytes);
+}
+
+/*
+ * One glyph changes, as in a ticking clock
+ */
+static void
+bench_refresh_char(ssd1306_handle_t h)
+{
+	uint64_t start, bytes;
+	int i;
+
+	bytes = bytes_sent(h);
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		ssd1306_putchar(h, 8, 3, '0' + i % 10);
+		ssd1306_refresh(h);
+	}
+	report("refresh_char", start, now_ns(), iterations,
+	    bytes_sent(h) - bytes);
+}
+
+static void
+bench_putstr(ssd1306_handle_t h)
+{
+	const char *str = "0123456789ABCDEF";
+	uint64_t start;
+	int i, n;
+
+	n = iterations * 10;
+	start = now_ns();
+	for (i = 0; i < n; i++)
+		ssd1306_putstr(h, i % 8, i % 8, str);
+	/* Per character */
+	report("putstr_char", start, now_ns(), n * strlen(str), 0);
+}
+
+/*
+ * Typical status screen: clear, few lines of text, bar, refresh
+ */
+static void
+bench_frame(ssd1306_handle_t h)
+{
+	char str[32];
+	uint64_t start, bytes;
+	int i, width, height, font_height;
+
+	width = ssd1306_width(h);
+	height = ssd1306_height(h);
+	font_height = ssd1306_font_height(h);
+	bytes = bytes_sent(h);
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		ssd1306_clear(h);
+		snprintf(str, sizeof(str), "FRAME %d", i);
+		ssd1306_putstr(h, 0, 0, str);
+		ssd1306_rect(h, 0, height - 8, width, 8, 1);
+		ssd1306_fill_rect(h, 2, height - 6, i % (width - 4), 4, 1);
+		if (2 * font_height <= height - 8)
+			ssd1306_putstr(h, 0, font_height, "STATUS: OK");
+		ssd1306_refresh(h);
+	}
+	report("frame", start, now_ns(), iterations, bytes_sent(h) - bytes);
+}
+
+static void
+bench_inky_pack(void)
+{
+	uint8_t *screen, *colorw, *color;
+	uint64_t start;
+	int i, size;
+
+	size = INKY_WIDTH * INKY_HEIGHT;
+	screen = malloc(size);
+	colorw = malloc(size / 8);
+	color = malloc(size / 8);
+	if ((screen == NULL) || (colorw == NULL) || (color == NULL))
+		goto out;
+	for (i = 0; i < size; i++)
+		screen[i] = random() % 3;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		inky_pack(screen, INKY_WIDTH, INKY_HEIGHT, colorw, color);
+		sink += colorw[i % (size / 8)] + color[i % (size / 8)];
+	}
+	/* Both planes are sent */
+	report("inky_pack", start, now_ns(), iterations,
+	    (uint64_t)iterations * size / 4);
+out:
+	free(screen);
+	free(colorw);
+	free(color);
+}
+
+static void
+bench_reg_to_temp(void)
+{
+	uint64_t start;
+	int i, n, sum;
+
+	n = iterations * 1000;
+	sum = 0;
+	start = now_ns();
+	for (i = 0; i < n; i++)
+		sum += tmp102_reg_to_temp(i & 0xffff, i & 1);
+	report("tmp102_reg_to_temp", start, now_ns(), n, 0);
+	sink += sum;
+}
+
+int
+main(int argc, char **argv)
+{
+	ssd1306_handle_t h;
+	const char *prog;
+	int ch, model;
+
+	prog = argv[0];
+	model = SSD1306_MODEL_128X64;
+	while ((ch = getopt(argc, argv, "m:n:")) != -1) {
+		switch (ch) {
+		case 'm':
+			model = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtol(optarg, NULL, 0);
+			break;
+		case '?':
+		default:
+			usage(prog);
+			return (1);
+		}
+	}
+
+	if (iterations <= 0) {
+		usage(prog);
+		return (1);
+	}
+
+	h = ssd1306_open_mock(model, 0);
+	if (h == SSD1306_INVALID_HANDLE) {
+		fprintf(stderr, "failed to create SSD1306 handle\n");
+		return (1);
+	}
+	if (ssd1306_initialize(h)) {
+		fprintf(stderr, "failed to initialize SSD1306\n");
+		ssd1306_close(h);
+		return (1);
+	}
+
+	printf("# benchmark\tns/op\tbytes/frame\tops/s\n");
+	bench_legacy(ssd1306_width(h), ssd1306_height(h));
+	bench_refresh_full(h, "refresh_full");
+	bench_refresh_idle(h);
+	bench_refresh_char(h);
+	bench_putstr(h);
+	bench_frame(h);
+	ssd1306_close(h);
+
+	/* Rotation is done at refresh time */
+	h = ssd1306_open_mock(model, SSD1306_FLAG_ROTATE);
+	if (h == SSD1306_INVALID_HANDLE) {
+		fprintf(stderr, "failed to create SSD1306 handle\n");
+		return (1);
+	}
+	ssd1306_initialize(h);
+	bench_refresh_full(h, "refresh_full_rotated");
+	ssd1306_close(h);
+
+	bench_inky_pack();
+	bench_reg_to_temp();
+
+	return (0);
+}
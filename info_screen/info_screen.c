@@ -32,6 +32,7 @@
 #include <string.h>
 #include <time.h>
 #include <limits.h>
+#include <signal.h>
 #include "ssd1306.h"
 #include "tmp102.h"
 
@@ -50,11 +51,71 @@ void usage(const char *prog)
 	fprintf(stderr, "\t-F\t\tshow temperature in Fahreheits\n");
 }
 
+static volatile sig_atomic_t dump_stats;
+
+static void
+siginfo_handler(int sig)
+{
+
+	dump_stats = 1;
+}
+
+static void
+print_hist(const char *name, const uint64_t *hist, int buckets)
+{
+	int i;
+
+	fprintf(stderr, "%s latency:", name);
+	for (i = 0; i < buckets; i++) {
+		if (hist[i] == 0)
+			continue;
+		if (i == buckets - 1)
+			fprintf(stderr, " >=%lluus:%llu", 1ULL << i,
+			    (unsigned long long)hist[i]);
+		else
+			fprintf(stderr, " <%lluus:%llu", 2ULL << i,
+			    (unsigned long long)hist[i]);
+	}
+	fprintf(stderr, "\n");
+}
+
+static void
+print_stats(ssd1306_handle_t ssd1306, tmp102_handle_t tmp102)
+{
+	struct ssd1306_stats ss;
+	struct tmp102_stats ts;
+
+	ssd1306_get_stats(ssd1306, &ss);
+	fprintf(stderr, "ssd1306: %llu refreshes (%llu skipped, %llu us), "
+	    "%llu transfers, %llu bytes, %llu gpio toggles\n",
+	    (unsigned long long)ss.refreshes,
+	    (unsigned long long)ss.refreshes_skipped,
+	    (unsigned long long)ss.refresh_usec,
+	    (unsigned long long)ss.transfers,
+	    (unsigned long long)ss.bytes,
+	    (unsigned long long)ss.gpio_toggles);
+	print_hist("ssd1306 refresh", ss.refresh_hist, SSD1306_HIST_BUCKETS);
+
+	tmp102_get_stats(tmp102, &ts);
+	fprintf(stderr, "tmp102: %llu reads (%llu us), %llu transfers, "
+	    "%llu bytes, %llu errors\n",
+	    (unsigned long long)ts.reads,
+	    (unsigned long long)ts.read_usec,
+	    (unsigned long long)ts.transfers,
+	    (unsigned long long)ts.bytes,
+	    (unsigned long long)ts.errors);
+	print_hist("tmp102 read", ts.read_hist, TMP102_HIST_BUCKETS);
+}
+
+/*
+ * Render all three screens, one under another, into canvas h. Every
+ * screen is height pixels tall.
+ */
 void
-paint_information_screen(ssd1306_handle_t h, int panoffset, int amb, int cpu, int fahrenheit)
+paint_information_screen(ssd1306_handle_t h, int height, int amb, int cpu, int fahrenheit)
 {
-	int width, height;
-	int font_width, font_height;
+	int width;
+	int font_height;
 	int x, y;
 	char str[16];
 	time_t current_time = time (NULL);
@@ -77,34 +138,29 @@ paint_information_screen(ssd1306_handle_t h, int panoffset, int amb, int cpu, in
 
 	ssd1306_clear(h);
 	width = ssd1306_width(h);
-	height = ssd1306_height(h);
-	font_width = ssd1306_font_width(h);
 	font_height = ssd1306_font_height(h);
 	if (has_amb)
 		snprintf(str, sizeof(str), "AMB: %.1f%c%c", amb/1000., '\xf8', scale);
 	else
 		snprintf(str, sizeof(str), "AMB: N/A");
 
-	x = (width - strlen(str) * font_width) / 2;
+	x = (width - ssd1306_measure(h, str)) / 2;
 	y = (height - font_height) / 2;
-	y -= panoffset;
 	ssd1306_putstr(h, x, y, str);
 
 	if (has_cpu)
 		snprintf(str, sizeof(str), "CPU: %.1f%c%c", cpu/1000., '\xf8', scale);
 	else
 		snprintf(str, sizeof(str), "CPU: N/A");
-	x = (width - strlen(str) * font_width) / 2;
+	x = (width - ssd1306_measure(h, str)) / 2;
 	y += height;
 	ssd1306_putstr(h, x, y, str);
 
 	snprintf(str, sizeof(str), "%02d:%02d",
 	    local_time->tm_hour, local_time->tm_min);
-	x = (width - strlen(str) * font_width) / 2;
+	x = (width - ssd1306_measure(h, str)) / 2;
 	y += height;
 	ssd1306_putstr(h, x, y, str);
-
-	ssd1306_refresh(h);
 }
 
 int
@@ -118,10 +174,11 @@ main(int argc, char **argv)
 	char scale;
 	int cpu_temp, amb_temp;
 	int flags;
-	int skip;
+	int skip, warm;
 	size_t oldlen;
 	tmp102_handle_t tmp102;
 	ssd1306_handle_t ssd1306;
+	ssd1306_handle_t canvas;
 
 	prog = argv[0];
 	i2c = "/dev/iic0";
@@ -164,6 +221,9 @@ main(int argc, char **argv)
 		fprintf(stderr, "Failed to open TMP102\n");
 		return (1);
 	}
+	/* Sensor converts 4 times a second, keep render loop off the bus */
+	if (tmp102_sampler_start(tmp102, 250, 16))
+		fprintf(stderr, "failed to start TMP102 sampler\n");
 
 
 	ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
@@ -172,20 +232,54 @@ main(int argc, char **argv)
 		return (1);
 	}
 
-	if (!skip && ssd1306_initialize(ssd1306)) {
+	warm = 1;
+	if (!skip)
+		warm = ssd1306_initialize_warm(ssd1306, SSD1306_STATE_FILE);
+	if (warm < 0) {
 		fprintf(stderr, "failed to initialize SSD1306\n");
 		ssd1306_close(ssd1306);
 		return (1);
 	}
 
 	ssd1306_clear(ssd1306);
-	ssd1306_refresh(ssd1306);
+	/* Blank frame hides RAM content left by reset */
+	if (!warm)
+		ssd1306_refresh(ssd1306);
+	/* Previous run might have left the display panned */
+	ssd1306_set_start_line(ssd1306, 0);
 	ssd1306_on(ssd1306);
 
 	int pan = 0;
 	int dir = 1;
+	int base = 0;
+	int height = ssd1306_height(ssd1306);
+	/* Screens are rendered once per cycle and panned through */
+	canvas = ssd1306_open_canvas(ssd1306_width(ssd1306), 3 * height);
+	if (canvas == SSD1306_INVALID_HANDLE) {
+		fprintf(stderr, "failed to create canvas\n");
+		ssd1306_close(ssd1306);
+		return (1);
+	}
+	/*
+	 * If two screens fit into display RAM, draw the next screen into
+	 * its hidden part and pan by moving the display start line
+	 */
+	int hwscroll = (2 * height <= SSD1306_RAM_HEIGHT);
+	int next;
+	/*
+	 * Software panning redraws every step, let background thread
+	 * push frames so transfer time doesn't add up to the step delay
+	 */
+	if (!hwscroll && ssd1306_async_start(ssd1306, 50))
+		fprintf(stderr, "failed to start async refresh\n");
+	/* Counters are printed on ^T */
+	signal(SIGINFO, siginfo_handler);
 	fahrenheit = 0;
 	while (1) {
+		if (dump_stats) {
+			dump_stats = 0;
+			print_stats(ssd1306, tmp102);
+		}
 		if (pan == 0) {
 			if (tmp102_read_temp(tmp102, &amb_temp))
 				amb_temp = INT_MIN;
@@ -195,16 +289,32 @@ main(int argc, char **argv)
 				cpu_temp = INT_MIN;
 		}
 
-		paint_information_screen(ssd1306, pan, amb_temp, cpu_temp, fahrenheit);
+		paint_information_screen(canvas, height, amb_temp, cpu_temp, fahrenheit);
+		ssd1306_view_canvas(ssd1306, canvas, 0, pan);
+		ssd1306_refresh(ssd1306);
 		sleep(2);
-		for (int i = 0; i < ssd1306_height(ssd1306); i++) {
-			pan += dir;
-			paint_information_screen(ssd1306, pan, amb_temp, cpu_temp, fahrenheit);
-			usleep(20000);
+		if (hwscroll) {
+			next = (base + dir * height + SSD1306_RAM_HEIGHT) % SSD1306_RAM_HEIGHT;
+			ssd1306_set_ram_offset(ssd1306, next);
+			pan += dir * height;
+			ssd1306_view_canvas(ssd1306, canvas, 0, pan);
+			ssd1306_refresh(ssd1306);
+			for (int i = 1; i <= height; i++) {
+				ssd1306_set_start_line(ssd1306, base + dir * i);
+				usleep(20000);
+			}
+			base = next;
+		} else {
+			for (int i = 0; i < height; i++) {
+				pan += dir;
+				ssd1306_view_canvas(ssd1306, canvas, 0, pan);
+				ssd1306_refresh(ssd1306);
+				usleep(20000);
+			}
 		}
 
-		if (pan >= 2*ssd1306_height(ssd1306)) {
-			pan = 2*ssd1306_height(ssd1306);
+		if (pan >= 2*height) {
+			pan = 2*height;
 			dir = -1;
 			fahrenheit = !fahrenheit;
 		}
@@ -38,6 +38,7 @@
 #include <time.h>
 
 #include "luts.h"
+#include "inky_pack.h"
 
 #define	GPIO_UNIT	0
 /* SPI0 CS0 */
@@ -55,10 +56,6 @@
 
 #define	INKY_INVALID_HANDLE	0
 
-#define	COLOR_BLACK	0x0
-#define	COLOR_RED	0x1
-#define	COLOR_WHITE	0x2
-
 struct inky_handle {
 	int		spi_fd;
 
@@ -221,36 +218,9 @@ inky_update(inky_handle_t h)
 {
 	/* temporary data buffer */
 	uint8_t data[16];
-	int x, y;
-	int sx, sy;
-	uint8_t *page, *scratch;
-	int bit, onoff, color;
-
-	memset(h->scratch_colorw, 0xff, h->scratch_size);
-	memset(h->scratch_color, 0x0, h->scratch_size);
-
-	for (x = 0; x < h->width; x++) {
-		for (y = 0; y < h->height; y++) {
-			sx = x;
-			sy = y;
-			color = h->screen[y * h->width + x];
-			if (color == COLOR_BLACK) {
-				scratch = h->scratch_colorw;
-				onoff = 0;
-			} else if (color == COLOR_RED) {
-				scratch = h->scratch_color;
-				onoff = 1;
-			}
-			else
-				continue;
-			page = scratch + ((sy*h->width + sx)/8);
-			bit = 7 - sx % 8;
-			if (onoff)
-				*page |= (1 << bit);
-			else
-				*page &= ~(1 << bit);
-		}
-	}
+
+	inky_pack(h->screen, h->width, h->height, h->scratch_colorw,
+	    h->scratch_color);
 
 	inky_reset(h);
 
@@ -0,0 +1,46 @@
+#ifndef	INKY_PACK_H
+#define	INKY_PACK_H
+
+#define	COLOR_BLACK	0x0
+#define	COLOR_RED	0x1
+#define	COLOR_WHITE	0x2
+
+/*
+ * Convert byte-per-pixel screen into two bit-per-pixel planes the
+ * controller takes: B/W one (0 is black) and Red/Yellow one (1 is
+ * color). Rows are packed MSB first, width has to be multiple of 8.
+ */
+static void
+inky_pack(const uint8_t *screen, int width, int height, uint8_t *colorw,
+    uint8_t *color)
+{
+	int x, y;
+	uint8_t *page, *scratch;
+	int bit, onoff, c;
+
+	memset(colorw, 0xff, width * height / 8);
+	memset(color, 0x0, width * height / 8);
+
+	for (x = 0; x < width; x++) {
+		for (y = 0; y < height; y++) {
+			c = screen[y * width + x];
+			if (c == COLOR_BLACK) {
+				scratch = colorw;
+				onoff = 0;
+			} else if (c == COLOR_RED) {
+				scratch = color;
+				onoff = 1;
+			}
+			else
+				continue;
+			page = scratch + ((y * width + x) / 8);
+			bit = 7 - x % 8;
+			if (onoff)
+				*page |= (1 << bit);
+			else
+				*page &= ~(1 << bit);
+		}
+	}
+}
+
+#endif /* INKY_PACK_H */
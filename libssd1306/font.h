@@ -1,4 +1,4 @@
-u_char dflt_font_16[16*256] = {
+const u_char dflt_font_16[16*256] = {
 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,126,129,165,129,129,189,153,129,129,
 126,0,0,0,0,0,0,126,255,219,255,255,195,231,255,255,126,0,0,0,0,0,0,0,0,
 108,254,254,254,254,124,56,16,0,0,0,0,0,0,0,0,16,56,124,254,124,56,16,0,
@@ -162,7 +162,7 @@ u_char dflt_font_16[16*256] = {
 0,0,124,124,124,124,124,124,124,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
 0
 };
-u_char dflt_font_14[14*256] = {
+const u_char dflt_font_14[14*256] = {
 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,126,129,165,129,129,189,153,129,126,0,0,
 0,0,0,126,255,219,255,255,195,231,255,126,0,0,0,0,0,0,108,254,254,254,254,
 124,56,16,0,0,0,0,0,0,16,56,124,254,124,56,16,0,0,0,0,0,0,24,60,60,231,
@@ -307,7 +307,7 @@ u_char dflt_font_14[14*256] = {
 0,0,0,0,0,0,112,216,48,96,200,248,0,0,0,0,0,0,0,0,0,0,0,124,124,124,124,
 124,124,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
 };
-u_char dflt_font_8[8*256] = {
+const u_char dflt_font_8[8*256] = {
 0,0,0,0,0,0,0,0,126,129,165,129,189,153,129,126,126,255,219,255,195,231,
 255,126,108,254,254,254,124,56,16,0,16,56,124,254,124,56,16,0,56,124,56,
 254,254,124,56,124,16,16,56,124,254,124,56,124,0,0,24,60,60,24,0,0,255,
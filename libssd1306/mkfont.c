@@ -0,0 +1,281 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Build-time generator of proportional fonts: trims the fixed-width
+ * bitmaps from font.h to their ink, computes per-glyph advance and a
+ * kerning table for printable ASCII pairs, and writes the result in
+ * the format described in ssd1306_font.h.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "font.h"
+#include "ssd1306_font.h"
+#include "ssd1306_pack.h"
+
+#define	FONT_WIDTH	8
+#define	FIRST_GLYPH	0x20
+#define	NGLYPHS		(256 - FIRST_GLYPH)
+#define	MAX_BANDS	2
+
+struct glyph {
+	int		left;		/* first column with ink */
+	int		width;
+	int		advance;
+	/* Per row extent of ink relative to left, -1 if row is empty */
+	int		lo[16];
+	int		hi[16];
+};
+
+static struct glyph glyphs[NGLYPHS];
+static struct ssd1306_font_kern kern[95 * 95];
+static int nkern;
+static uint8_t bitmap[NGLYPHS * MAX_BANDS * FONT_WIDTH];
+static int bitmap_size;
+static uint16_t offsets[NGLYPHS];
+
+static void
+usage(const char *prog)
+{
+
+	fprintf(stderr, "%s: [-o file] -s 8|14|16\n", prog);
+	exit(1);
+}
+
+static void
+scan_glyph(const u_char *font, int height, int c, struct glyph *g)
+{
+	uint8_t row;
+	int r, x, left, right;
+
+	left = FONT_WIDTH;
+	right = -1;
+	for (r = 0; r < height; r++) {
+		row = font[c * height + r];
+		for (x = 0; x < FONT_WIDTH; x++) {
+			if ((row & (0x80 >> x)) == 0)
+				continue;
+			if (x < left)
+				left = x;
+			if (x > right)
+				right = x;
+		}
+	}
+
+	if (right < 0) {
+		/* Blank glyph, space takes half of the fixed cell */
+		g->left = 0;
+		g->width = 0;
+		g->advance = FONT_WIDTH / 2;
+	} else {
+		g->left = left;
+		g->width = right - left + 1;
+		/* Line drawing glyphs have to join their neighbours */
+		g->advance = ((left == 0) && (right == FONT_WIDTH - 1)) ?
+		    FONT_WIDTH : g->width + 1;
+	}
+
+	for (r = 0; r < height; r++) {
+		g->lo[r] = g->hi[r] = -1;
+		row = font[c * height + r];
+		for (x = 0; x < FONT_WIDTH; x++) {
+			if ((row & (0x80 >> x)) == 0)
+				continue;
+			if (g->lo[r] < 0)
+				g->lo[r] = x - g->left;
+			g->hi[r] = x - g->left;
+		}
+	}
+}
+
+static void
+emit_bitmap(const u_char *font, int height, int c, const struct glyph *g)
+{
+	uint8_t rows[8], cols[8];
+	int band, bands, i;
+
+	offsets[c - FIRST_GLYPH] = bitmap_size;
+	bands = (height + 7) / 8;
+	for (band = 0; band < bands; band++) {
+		for (i = 0; i < 8; i++)
+			rows[i] = (band * 8 + i < height) ?
+			    font[c * height + band * 8 + i] : 0;
+		ssd1306_transpose8(rows, cols);
+		memcpy(bitmap + bitmap_size, cols + g->left, g->width);
+		bitmap_size += g->width;
+	}
+}
+
+/*
+ * Pull right glyph closer while at least one blank column is left
+ * between the two in every row and its neighbours, so that glyphs
+ * don't touch even diagonally
+ */
+static int
+kern_pair(const struct glyph *a, const struct glyph *b, int height)
+{
+	int r, n, hi, gap, mingap, limit;
+
+	if ((a->width == 0) || (b->width == 0) ||
+	    (a->advance == FONT_WIDTH) || (b->advance == FONT_WIDTH))
+		return (0);
+
+	mingap = FONT_WIDTH;
+	for (r = 0; r < height; r++) {
+		if (b->lo[r] < 0)
+			continue;
+		hi = -1;
+		for (n = r - 1; n <= r + 1; n++)
+			if ((n >= 0) && (n < height) && (a->hi[n] > hi))
+				hi = a->hi[n];
+		if (hi < 0)
+			continue;
+		gap = (a->advance - 1 - hi) + b->lo[r];
+		if (gap < mingap)
+			mingap = gap;
+	}
+
+	limit = (height + 7) / 8;
+	if (mingap <= 1)
+		return (0);
+	return (-(mingap - 1 > limit ? limit : mingap - 1));
+}
+
+static void
+wr16(uint8_t *p, uint16_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void
+wr32(uint8_t *p, uint32_t v)
+{
+
+	wr16(p, v & 0xffff);
+	wr16(p + 2, v >> 16);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t hdr[SSD1306_FONT_HDR_SIZE], rec[4];
+	const u_char *font;
+	const char *out;
+	FILE *f;
+	int ch, c, a, b, i, adjust, size;
+
+	out = NULL;
+	size = 0;
+	while ((ch = getopt(argc, argv, "o:s:")) != -1) {
+		switch (ch) {
+		case 'o':
+			out = optarg;
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	switch (size) {
+	case 8:
+		font = dflt_font_8;
+		break;
+	case 14:
+		font = dflt_font_14;
+		break;
+	case 16:
+		font = dflt_font_16;
+		break;
+	default:
+		usage(argv[0]);
+	}
+
+	for (c = FIRST_GLYPH; c < 256; c++) {
+		scan_glyph(font, size, c, &glyphs[c - FIRST_GLYPH]);
+		emit_bitmap(font, size, c, &glyphs[c - FIRST_GLYPH]);
+	}
+
+	/* Generated in the order the library looks pairs up in */
+	for (a = '!'; a <= '~'; a++)
+		for (b = '!'; b <= '~'; b++) {
+			adjust = kern_pair(&glyphs[a - FIRST_GLYPH],
+			    &glyphs[b - FIRST_GLYPH], size);
+			if (adjust == 0)
+				continue;
+			kern[nkern].left = a;
+			kern[nkern].right = b;
+			kern[nkern].adjust = adjust;
+			nkern++;
+		}
+
+	f = (out != NULL) ? fopen(out, "wb") : stdout;
+	if (f == NULL) {
+		perror(out);
+		return (1);
+	}
+
+	memset(hdr, 0, sizeof(hdr));
+	wr32(hdr, SSD1306_FONT_MAGIC);
+	hdr[4] = SSD1306_FONT_VERSION;
+	hdr[5] = size;
+	hdr[6] = FIRST_GLYPH;
+	wr16(hdr + 8, NGLYPHS);
+	wr16(hdr + 10, nkern);
+	wr32(hdr + 12, bitmap_size);
+	fwrite(hdr, sizeof(hdr), 1, f);
+	for (i = 0; i < NGLYPHS; i++) {
+		wr16(rec, offsets[i]);
+		rec[2] = glyphs[i].width;
+		rec[3] = glyphs[i].advance;
+		fwrite(rec, sizeof(rec), 1, f);
+	}
+	for (i = 0; i < nkern; i++) {
+		rec[0] = kern[i].left;
+		rec[1] = kern[i].right;
+		rec[2] = (uint8_t)kern[i].adjust;
+		rec[3] = 0;
+		fwrite(rec, sizeof(rec), 1, f);
+	}
+	fwrite(bitmap, bitmap_size, 1, f);
+
+	if ((fflush(f) != 0) || ferror(f)) {
+		perror(out != NULL ? out : "stdout");
+		return (1);
+	}
+	if (out != NULL)
+		fclose(f);
+
+	return (0);
+}
@@ -0,0 +1,76 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Build-time generator of the font atlas: converts row-major bitmaps
+ * from font.h into SSD1306 page format, so glyphs can be copied into
+ * the frame buffer without transposing them at run time. Every glyph
+ * is stored as bands of 8 rows, each band as FONT_WIDTH column bytes.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "font.h"
+#include "ssd1306_pack.h"
+
+#define	FONT_WIDTH	8
+
+static void
+emit_font(const char *name, const u_char *font, int height)
+{
+	uint8_t rows[8], cols[8];
+	int c, band, bands, i;
+
+	bands = (height + 7) / 8;
+	printf("static const uint8_t %s[256 * %d * %d] = {\n",
+	    name, bands, FONT_WIDTH);
+	for (c = 0; c < 256; c++) {
+		printf("\t/* 0x%02x */", c);
+		for (band = 0; band < bands; band++) {
+			for (i = 0; i < 8; i++)
+				rows[i] = (band * 8 + i < height) ?
+				    font[c * height + band * 8 + i] : 0;
+			ssd1306_transpose8(rows, cols);
+			for (i = 0; i < FONT_WIDTH; i++)
+				printf(" 0x%02x,", cols[i]);
+		}
+		printf("\n");
+	}
+	printf("};\n\n");
+}
+
+int
+main(void)
+{
+
+	printf("/* Generated by mkfontatlas from font.h, do not edit */\n\n");
+	emit_font("font_atlas_8", dflt_font_8, 8);
+	emit_font("font_atlas_14", dflt_font_14, 14);
+	emit_font("font_atlas_16", dflt_font_16, 16);
+
+	return (0);
+}
@@ -0,0 +1,1170 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+#include "ssd1306_pack.h"
+#include "font_atlas.h"
+
+/*
+ * Drive DC line, 0 for commands and 1 for data, unless it is already there
+ */
+static int
+ssd1306_set_dc(ssd1306_handle_t h, int dc)
+{
+	int err;
+
+	if ((h->ops->set_dc == NULL) || (h->regs.dc == dc))
+		return (0);
+	err = h->ops->set_dc(h, dc);
+	h->regs.dc = err ? -1 : dc;
+	h->stats.gpio_toggles++;
+
+	return (err ? -1 : 0);
+}
+
+void
+ssd1306_regs_invalidate(ssd1306_handle_t h)
+{
+
+	h->regs.display_on = -1;
+	h->regs.contrast = -1;
+	h->regs.inverse = -1;
+	h->regs.startline = -1;
+	h->regs.col0 = h->regs.col1 = -1;
+	h->regs.page0 = h->regs.page1 = -1;
+}
+
+/*
+ * Check if register already holds val and the command can be skipped
+ */
+static int
+ssd1306_reg_cached(ssd1306_handle_t h, int reg, int val)
+{
+
+	return (!h->ops->shared && (reg == val));
+}
+
+/*
+ * Send sequence of command bytes with single DC transition and as few
+ * transfers as possible
+ */
+int
+ssd1306_commands(ssd1306_handle_t h, const uint8_t *cmds, int len)
+{
+	uint8_t buf[CMDBUF_SIZE];
+	int chunk, err;
+
+	SSD1306_IO_LOCK(h);
+	err = ssd1306_set_dc(h, 0);
+	while ((err == 0) && (len > 0)) {
+		/* Transfer overwrites data, send a copy */
+		chunk = len < CMDBUF_SIZE ? len : CMDBUF_SIZE;
+		memcpy(buf, cmds, chunk);
+		err = h->ops->write(h, 0, buf, chunk);
+		h->stats.transfers++;
+		h->stats.bytes += chunk;
+		cmds += chunk;
+		len -= chunk;
+	}
+	/* Part of the sequence may have gone through */
+	if (err)
+		ssd1306_regs_invalidate(h);
+	SSD1306_IO_UNLOCK(h);
+
+	return (err ? -1 : 0);
+}
+
+static int
+ssd1306_command(ssd1306_handle_t h, uint8_t cmd)
+{
+
+	return ssd1306_commands(h, &cmd, 1);
+}
+
+static int
+ssd1306_data(ssd1306_handle_t h, uint8_t *data, int len)
+{
+
+	/* Write pointer is left somewhere inside the window on failure */
+	h->regs.col0 = h->regs.col1 = -1;
+	h->regs.page0 = h->regs.page1 = -1;
+	if (ssd1306_set_dc(h, 1))
+		return (-1);
+	h->stats.transfers++;
+	h->stats.bytes += len;
+	if (h->ops->write(h, 1, data, len))
+		return (-1);
+
+	return (0);
+}
+
+static int
+ssd1306_reset(ssd1306_handle_t h)
+{
+
+	/* Not every module has reset line */
+	if (h->ops->reset == NULL)
+		return (0);
+
+	return h->ops->reset(h);
+}
+
+/* Charge pump and precharge settings, indexed by ssd1306_vccstate */
+static const uint8_t ssd1306_chargepump[] = { 0x10, 0x14 };
+static const uint8_t ssd1306_precharge[] = { 0x22, 0xF1 };
+
+static const struct ssd1306_model_desc ssd1306_models[] = {
+	[SSD1306_MODEL_96X16] = {
+		.width = 96,
+		.height = 16,
+		.multiplex = 0x0F,
+		.compins = 0x02,
+		.contrast = {
+			[SSD1306_EXTERNALVCC] = 0x10,
+			[SSD1306_SWITCHCAPVCC] = 0xAF,
+		},
+	},
+	[SSD1306_MODEL_128X32] = {
+		.width = 128,
+		.height = 32,
+		.multiplex = 0x1F,
+		.compins = 0x02,
+		.contrast = {
+			[SSD1306_EXTERNALVCC] = 0x8F,
+			[SSD1306_SWITCHCAPVCC] = 0x8F,
+		},
+	},
+	[SSD1306_MODEL_128X64] = {
+		.width = 128,
+		.height = 64,
+		.multiplex = 0x3F,
+		.compins = 0x12,
+		.contrast = {
+			[SSD1306_EXTERNALVCC] = 0x9F,
+			[SSD1306_SWITCHCAPVCC] = 0xCF,
+		},
+	},
+};
+
+#define	SSD1306_NMODELS	(sizeof(ssd1306_models) / sizeof(ssd1306_models[0]))
+
+void
+ssd1306_dirty_mark(ssd1306_handle_t h, int page, int lo, int hi)
+{
+	struct ssd1306_dirty *d;
+
+	d = &h->dirty[page];
+	if (lo < d->lo)
+		d->lo = lo;
+	if (hi > d->hi)
+		d->hi = hi;
+}
+
+/* Mark whole frame as dirty in per-page ranges array */
+void
+ssd1306_dirty_fill(ssd1306_handle_t h, struct ssd1306_dirty *dirty)
+{
+	int page;
+
+	for (page = 0; page < h->pages; page++) {
+		dirty[page].lo = 0;
+		dirty[page].hi = h->width - 1;
+	}
+}
+
+/* Mark whole frame as clean in per-page ranges array */
+void
+ssd1306_dirty_clean(ssd1306_handle_t h, struct ssd1306_dirty *dirty)
+{
+	int page;
+
+	for (page = 0; page < h->pages; page++) {
+		dirty[page].lo = h->width;
+		dirty[page].hi = -1;
+	}
+}
+
+static void
+ssd1306_dirty_all(ssd1306_handle_t h)
+{
+
+	ssd1306_dirty_fill(h, h->dirty);
+}
+
+static void
+ssd1306_dirty_reset(ssd1306_handle_t h)
+{
+
+	ssd1306_dirty_clean(h, h->dirty);
+}
+
+void
+ssd1306_clear(ssd1306_handle_t h)
+{
+
+	memset(h->fb, 0, h->fb_size);
+	ssd1306_dirty_all(h);
+}
+
+/*
+ * Display RAM page that holds frame buffer page. Frame buffer starts
+ * ram_offset rows into display RAM; when rotated, the whole RAM is
+ * mirrored, so the panel shows the frame buffer upside down at the
+ * same logical start line.
+ */
+static int
+ssd1306_ram_page(ssd1306_handle_t h, int page)
+{
+
+	page += h->ram_offset / 8;
+	if (h->flags & SSD1306_FLAG_ROTATE)
+		page = SSD1306_RAM_HEIGHT / 8 - 1 - page;
+
+	return (page);
+}
+
+/* Controller start line register value for logical start line */
+static int
+ssd1306_ram_line(ssd1306_handle_t h, int line)
+{
+
+	if (h->flags & SSD1306_FLAG_ROTATE)
+		line = SSD1306_RAM_HEIGHT - h->height - line;
+
+	return (line & (SSD1306_RAM_HEIGHT - 1));
+}
+
+/*
+ * Send rectangle of pages p0..p1 and columns x0..x1 of the frame buffer
+ */
+static int
+ssd1306_flush_window(ssd1306_handle_t h, const uint8_t *fb, int p0, int p1,
+    int x0, int x1)
+{
+	uint8_t cmds[6];
+	uint8_t *out;
+	int page, x, len;
+
+	/*
+	 * Frame buffer is already in controller format, copy it to scratch
+	 * buffer because transport may overwrite the data. Rotating by 180
+	 * degrees mirrors the window and flips every byte.
+	 */
+	out = h->scratch;
+	len = (p1 - p0 + 1) * (x1 - x0 + 1);
+	if (h->flags & SSD1306_FLAG_ROTATE) {
+		for (page = p1; page >= p0; page--) {
+			ssd1306_rotate_span(out, fb + page * h->width + x0,
+			    x1 - x0 + 1);
+			out += x1 - x0 + 1;
+		}
+		x = x0;
+		x0 = h->width - x1 - 1;
+		x1 = h->width - x - 1;
+		page = p0;
+		p0 = ssd1306_ram_page(h, p1);
+		p1 = ssd1306_ram_page(h, page);
+	} else {
+		for (page = p0; page <= p1; page++) {
+			memcpy(out, fb + page * h->width + x0, x1 - x0 + 1);
+			out += x1 - x0 + 1;
+		}
+		p0 = ssd1306_ram_page(h, p0);
+		p1 = ssd1306_ram_page(h, p1);
+	}
+
+	/* Skip address setup if write pointer is already at window start */
+	if ((h->regs.col0 != x0) || (h->regs.col1 != x1) ||
+	    (h->regs.page0 != p0) || (h->regs.page1 != p1)) {
+		cmds[0] = SSD1306_COLUMNADDR;
+		cmds[1] = x0;
+		cmds[2] = x1;
+		cmds[3] = SSD1306_PAGEADDR;
+		cmds[4] = p0;
+		cmds[5] = p1;
+		if (ssd1306_commands(h, cmds, sizeof(cmds)))
+			return (-1);
+	}
+
+	if (ssd1306_data(h, h->scratch, len))
+		return (-1);
+
+	h->regs.col0 = x0;
+	h->regs.col1 = x1;
+	h->regs.page0 = p0;
+	h->regs.page1 = p1;
+
+	return (0);
+}
+
+static void
+ssd1306_stats_refresh(ssd1306_handle_t h, const struct timespec *start,
+    const struct timespec *end, int sent)
+{
+	uint64_t usec;
+	int bucket;
+
+	usec = (end->tv_sec - start->tv_sec) * 1000000ULL +
+	    (end->tv_nsec - start->tv_nsec) / 1000;
+	for (bucket = 0; bucket < SSD1306_HIST_BUCKETS - 1; bucket++)
+		if (usec < (2ULL << bucket))
+			break;
+
+	h->stats.refreshes++;
+	if (sent == 0)
+		h->stats.refreshes_skipped++;
+	h->stats.refresh_usec += usec;
+	h->stats.refresh_hist[bucket]++;
+}
+
+void
+ssd1306_get_stats(ssd1306_handle_t h, struct ssd1306_stats *stats)
+{
+
+	SSD1306_IO_LOCK(h);
+	*stats = h->stats;
+	SSD1306_IO_UNLOCK(h);
+}
+
+void
+ssd1306_reset_stats(ssd1306_handle_t h)
+{
+
+	SSD1306_IO_LOCK(h);
+	memset(&h->stats, 0, sizeof(h->stats));
+	SSD1306_IO_UNLOCK(h);
+}
+
+/*
+ * Send frame buffer fb to the controller. dirty holds per-page ranges
+ * of columns that may differ from what was sent last time and is reset
+ * once they are sent.
+ */
+int
+ssd1306_send(ssd1306_handle_t h, const uint8_t *fb, struct ssd1306_dirty *dirty)
+{
+	struct ssd1306_dirty *d;
+	struct timespec start, end;
+	int page, p0, p1, x0, x1;
+	int lo, hi, merged, separate;
+	int err, sent;
+
+	SSD1306_IO_LOCK(h);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/*
+	 * Trim dirty ranges to the columns that really differ from
+	 * what the controller already has, so redrawing the same
+	 * content costs nothing
+	 */
+	for (page = 0; page < h->pages && h->shadow_valid; page++) {
+		d = &dirty[page];
+		while (d->lo <= d->hi &&
+		    fb[page * h->width + d->lo] == h->shadow[page * h->width + d->lo])
+			d->lo++;
+		while (d->hi >= d->lo &&
+		    fb[page * h->width + d->hi] == h->shadow[page * h->width + d->hi])
+			d->hi--;
+	}
+
+	/*
+	 * Combine dirty pages into as few windows as possible as long as
+	 * resending clean columns is cheaper than setting up new window
+	 */
+	err = 0;
+	sent = 0;
+	p0 = -1;
+	p1 = x0 = x1 = 0;
+	for (page = 0; page < h->pages; page++) {
+		d = &dirty[page];
+		if (d->lo > d->hi)
+			continue;
+		if (p0 >= 0) {
+			lo = d->lo < x0 ? d->lo : x0;
+			hi = d->hi > x1 ? d->hi : x1;
+			merged = (page - p0 + 1) * (hi - lo + 1);
+			separate = (p1 - p0 + 1) * (x1 - x0 + 1) +
+			    (d->hi - d->lo + 1) + WINDOW_COST;
+			if (merged <= separate) {
+				p1 = page;
+				x0 = lo;
+				x1 = hi;
+				continue;
+			}
+			if (ssd1306_flush_window(h, fb, p0, p1, x0, x1))
+				err = -1;
+			sent++;
+		}
+		p0 = p1 = page;
+		x0 = d->lo;
+		x1 = d->hi;
+	}
+	if (p0 >= 0) {
+		if (ssd1306_flush_window(h, fb, p0, p1, x0, x1))
+			err = -1;
+		sent++;
+	}
+
+	if (err) {
+		/* Controller state is unknown, resend everything next time */
+		h->shadow_valid = 0;
+		ssd1306_dirty_fill(h, dirty);
+	} else {
+		memcpy(h->shadow, fb, h->fb_size);
+		h->shadow_valid = 1;
+		ssd1306_dirty_clean(h, dirty);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ssd1306_stats_refresh(h, &start, &end, sent);
+	SSD1306_IO_UNLOCK(h);
+
+	return (err);
+}
+
+int
+ssd1306_refresh(ssd1306_handle_t h)
+{
+
+	/* Canvas content is only shown through ssd1306_view_canvas */
+	if (h->desc == NULL)
+		return (-1);
+	/* Frame buffer is shared with the daemon that sends it */
+	if (h->ops->refresh != NULL)
+		return (h->ops->refresh(h));
+	/* Frame goes to the flusher thread in asynchronous mode */
+	if (h->async != NULL)
+		return (ssd1306_present(h));
+
+	return ssd1306_send(h, h->fb, h->dirty);
+}
+
+int
+ssd1306_width(ssd1306_handle_t h)
+{
+	return h->width;
+}
+
+int ssd1306_height(ssd1306_handle_t h)
+{
+	return h->height;
+}
+
+int
+ssd1306_set_font(ssd1306_handle_t h, ssd1306_font font)
+{
+
+	switch (font) {
+	case SSD1306_FONT_8:
+	case SSD1306_FONT_14:
+	case SSD1306_FONT_16:
+		break;
+	default:
+		return (-1);
+	}
+	h->font = font;
+	h->pfont = NULL;
+
+	return (0);
+}
+
+/* Widest glyph advance for proportional fonts */
+int ssd1306_font_width(ssd1306_handle_t h)
+{
+	if (h->pfont != NULL)
+		return (ssd1306_pfont_width(h->pfont));
+	return FONT_WIDTH;
+}
+
+int ssd1306_font_height(ssd1306_handle_t h)
+{
+	if (h->pfont != NULL)
+		return (ssd1306_pfont_height(h->pfont));
+	switch (h->font) {
+	case SSD1306_FONT_8:
+		return (8);
+		break;
+	case SSD1306_FONT_14:
+		return (14);
+		break;
+	case SSD1306_FONT_16:
+		return (16);
+		break;
+	default:
+		return (-1);
+	}
+}
+
+static int
+ssd1306_set_display(ssd1306_handle_t h, int on)
+{
+
+	if (ssd1306_reg_cached(h, h->regs.display_on, on))
+		return (0);
+	h->regs.display_on = -1;
+	if (ssd1306_command(h, on ? SSD1306_DISPLAYON : SSD1306_DISPLAYOFF))
+		return (-1);
+	h->regs.display_on = on;
+
+	return (0);
+}
+
+int
+ssd1306_on(ssd1306_handle_t h)
+{
+
+	return ssd1306_set_display(h, 1);
+}
+
+int
+ssd1306_off(ssd1306_handle_t h)
+{
+
+	return ssd1306_set_display(h, 0);
+}
+
+int
+ssd1306_set_contrast(ssd1306_handle_t h, int contrast)
+{
+	uint8_t cmds[2];
+
+	if ((contrast < 0) || (contrast > 255))
+		return (-1);
+	if (ssd1306_reg_cached(h, h->regs.contrast, contrast))
+		return (0);
+	cmds[0] = SSD1306_SETCONTRAST;
+	cmds[1] = contrast;
+	h->regs.contrast = -1;
+	if (ssd1306_commands(h, cmds, sizeof(cmds)))
+		return (-1);
+	h->regs.contrast = contrast;
+
+	return (0);
+}
+
+int
+ssd1306_set_inverse(ssd1306_handle_t h, int inverse)
+{
+
+	inverse = inverse ? 1 : 0;
+	if (ssd1306_reg_cached(h, h->regs.inverse, inverse))
+		return (0);
+	h->regs.inverse = -1;
+	if (ssd1306_command(h,
+	    inverse ? SSD1306_INVERTDISPLAY : SSD1306_NORMALDISPLAY))
+		return (-1);
+	h->regs.inverse = inverse;
+	if (inverse)
+		h->flags |= SSD1306_FLAG_INVERSE;
+	else
+		h->flags &= ~SSD1306_FLAG_INVERSE;
+
+	return (0);
+}
+
+/*
+ * Select which display RAM line is shown at the top of the panel.
+ * Display RAM is SSD1306_RAM_HEIGHT lines tall and wraps around, so
+ * content already in RAM can be panned by one command per step.
+ */
+int
+ssd1306_set_start_line(ssd1306_handle_t h, int line)
+{
+	uint8_t cmd;
+
+	line = ((line % SSD1306_RAM_HEIGHT) + SSD1306_RAM_HEIGHT) %
+	    SSD1306_RAM_HEIGHT;
+	if (ssd1306_reg_cached(h, h->regs.startline, line))
+		return (0);
+	cmd = SSD1306_SETSTARTLINE | ssd1306_ram_line(h, line);
+	h->regs.startline = -1;
+	if (ssd1306_command(h, cmd))
+		return (-1);
+	h->regs.startline = line;
+
+	return (0);
+}
+
+/*
+ * Select display RAM line refresh stores the top of the frame buffer
+ * at. Frame buffer can be placed into the part of RAM that is not
+ * shown and then panned to with ssd1306_set_start_line().
+ */
+int
+ssd1306_set_ram_offset(ssd1306_handle_t h, int line)
+{
+
+	if ((line < 0) || (line % 8) ||
+	    (line + h->height > SSD1306_RAM_HEIGHT))
+		return (-1);
+	/* Flusher thread sends frames at its own pace */
+	if (h->async != NULL)
+		return (-1);
+	if (h->ram_offset == line)
+		return (0);
+
+	/* Content of the new area is unknown */
+	h->ram_offset = line;
+	h->shadow_valid = 0;
+	ssd1306_dirty_all(h);
+
+	return (0);
+}
+
+/*
+ * Continuous hardware scrolling. Pages and vertical offset are in
+ * display RAM terms, interval is the controller's frame interval code
+ * (0 - 5 frames, 1 - 64, 2 - 128, 3 - 256, 4 - 3, 5 - 4, 6 - 25, 7 - 2).
+ */
+int
+ssd1306_scroll_horizontal(ssd1306_handle_t h, ssd1306_scroll_dir dir,
+    int start_page, int end_page, int interval)
+{
+	uint8_t cmds[7];
+
+	if ((start_page < 0) || (end_page < start_page) ||
+	    (end_page >= SSD1306_RAM_HEIGHT / 8) || (interval & ~7))
+		return (-1);
+
+	cmds[0] = (dir == SSD1306_SCROLL_LEFT) ?
+	    SSD1306_LEFT_HORIZONTAL_SCROLL : SSD1306_RIGHT_HORIZONTAL_SCROLL;
+	cmds[1] = 0x00; /* dummy */
+	cmds[2] = start_page;
+	cmds[3] = interval;
+	cmds[4] = end_page;
+	cmds[5] = 0x00; /* dummy */
+	cmds[6] = 0xFF; /* dummy */
+
+	return ssd1306_commands(h, cmds, sizeof(cmds));
+}
+
+int
+ssd1306_scroll_diagonal(ssd1306_handle_t h, ssd1306_scroll_dir dir,
+    int start_page, int end_page, int interval, int vertical_offset)
+{
+	uint8_t cmds[6];
+
+	if ((start_page < 0) || (end_page < start_page) ||
+	    (end_page >= SSD1306_RAM_HEIGHT / 8) || (interval & ~7) ||
+	    (vertical_offset < 0) || (vertical_offset >= SSD1306_RAM_HEIGHT))
+		return (-1);
+
+	cmds[0] = (dir == SSD1306_SCROLL_LEFT) ?
+	    SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL :
+	    SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL;
+	cmds[1] = 0x00; /* dummy */
+	cmds[2] = start_page;
+	cmds[3] = interval;
+	cmds[4] = end_page;
+	cmds[5] = vertical_offset;
+
+	return ssd1306_commands(h, cmds, sizeof(cmds));
+}
+
+/* Rows affected by vertical part of the diagonal scroll */
+int
+ssd1306_scroll_area(ssd1306_handle_t h, int top, int rows)
+{
+	uint8_t cmds[3];
+
+	if ((top < 0) || (rows < 0) || (top + rows > SSD1306_RAM_HEIGHT))
+		return (-1);
+
+	cmds[0] = SSD1306_SET_VERTICAL_SCROLL_AREA;
+	cmds[1] = top;
+	cmds[2] = rows;
+
+	return ssd1306_commands(h, cmds, sizeof(cmds));
+}
+
+int
+ssd1306_scroll_start(ssd1306_handle_t h)
+{
+
+	return ssd1306_command(h, SSD1306_ACTIVATE_SCROLL);
+}
+
+int
+ssd1306_scroll_stop(ssd1306_handle_t h)
+{
+	int err;
+
+	SSD1306_IO_LOCK(h);
+	/* Scrolling moved RAM content around, it has to be rewritten */
+	h->shadow_valid = 0;
+	ssd1306_dirty_all(h);
+	err = ssd1306_command(h, SSD1306_DEACTIVATE_SCROLL);
+	SSD1306_IO_UNLOCK(h);
+
+	return (err);
+}
+
+void
+ssd1306_putpixel(ssd1306_handle_t h, int x, int y, int v)
+{
+	if ((x < 0) || (y < 0))
+		return;
+	if ((x >= h->width) || (y >= h->height))
+		return;
+
+	if (v)
+		h->fb[(y / 8) * h->width + x] |= (1 << (y % 8));
+	else
+		h->fb[(y / 8) * h->width + x] &= ~(1 << (y % 8));
+	ssd1306_dirty_mark(h, y / 8, x, x);
+}
+
+/*
+ * Write n page-format columns, 8 pixels tall, with top left corner at
+ * (x, y). Bit 0 of every column is its topmost pixel and only pixels set
+ * in mask are modified. Clipping is done once for the whole band, an
+ * 8-aligned band is stored directly into one page, otherwise it is
+ * split between two adjacent pages.
+ */
+void
+ssd1306_blit_band(ssd1306_handle_t h, int x, int y, const uint8_t *cols,
+    uint8_t mask, int n)
+{
+	int c0, c1, c, page, shift;
+	uint8_t m;
+	uint8_t *p;
+
+	if ((y <= -8) || (y >= h->height))
+		return;
+	c0 = (x < 0) ? -x : 0;
+	c1 = (x + n > h->width) ? h->width - x : n;
+	if (c0 >= c1)
+		return;
+
+	page = (y + 8) / 8 - 1;
+	shift = y - page * 8;
+	if ((shift == 0) && (mask == 0xff)) {
+		memcpy(h->fb + page * h->width + x + c0, cols + c0, c1 - c0);
+		ssd1306_dirty_mark(h, page, x + c0, x + c1 - 1);
+		return;
+	}
+	if ((page >= 0) && (m = mask << shift) != 0) {
+		p = h->fb + page * h->width + x;
+		for (c = c0; c < c1; c++)
+			p[c] = (p[c] & ~m) | ((cols[c] << shift) & m);
+		ssd1306_dirty_mark(h, page, x + c0, x + c1 - 1);
+	}
+	if ((shift == 0) || (page + 1 >= h->pages))
+		return;
+	if ((m = mask >> (8 - shift)) != 0) {
+		p = h->fb + (page + 1) * h->width + x;
+		for (c = c0; c < c1; c++)
+			p[c] = (p[c] & ~m) | ((cols[c] >> (8 - shift)) & m);
+		ssd1306_dirty_mark(h, page + 1, x + c0, x + c1 - 1);
+	}
+}
+
+/*
+ * Glyphs in page format, generated from font.h at build time
+ */
+static const uint8_t *
+ssd1306_font_data(ssd1306_handle_t h, int *font_height)
+{
+
+	switch (h->font) {
+	case SSD1306_FONT_8:
+		*font_height = 8;
+		return (font_atlas_8);
+	case SSD1306_FONT_14:
+		*font_height = 14;
+		return (font_atlas_14);
+	case SSD1306_FONT_16:
+		*font_height = 16;
+		return (font_atlas_16);
+	default:
+		return (NULL);
+	}
+}
+
+void
+ssd1306_putchar(ssd1306_handle_t h, int x, int y, unsigned char c)
+{
+	int cy, bands;
+	const uint8_t *glyph;
+	int font_height;
+	uint8_t mask;
+
+	if (h->pfont != NULL) {
+		ssd1306_pfont_putchar(h, x, y, c);
+		return;
+	}
+	glyph = ssd1306_font_data(h, &font_height);
+	if (glyph == NULL)
+		return;
+
+	/* Whole glyph is out of screen */
+	if ((x >= h->width) || (x + FONT_WIDTH <= 0) ||
+	    (y >= h->height) || (y + font_height <= 0))
+		return;
+
+	bands = (font_height + 7) / 8;
+	glyph += c * bands * FONT_WIDTH;
+	for (cy = 0; cy < font_height; cy += 8, glyph += FONT_WIDTH) {
+		if ((y + cy <= -8) || (y + cy >= h->height))
+			continue;
+		mask = (font_height - cy >= 8) ?
+		    0xff : (1 << (font_height - cy)) - 1;
+		ssd1306_blit_band(h, x, y + cy, glyph, mask, FONT_WIDTH);
+	}
+}
+
+void
+ssd1306_putstr(ssd1306_handle_t h, int x, int y, const char *s)
+{
+	int i, len;
+
+	if (h->pfont != NULL) {
+		ssd1306_pfont_putstr(h, x, y, s);
+		return;
+	}
+	len = strlen(s);
+	for (i = 0; i < len; i++) {
+		if (x + FONT_WIDTH * i >= h->width)
+			break;
+		ssd1306_putchar(h, x + FONT_WIDTH * i, y, s[i]);
+	}
+}
+
+/*
+ * Allocate handle and buffers for the model, transport-specific part
+ * is filled in by the caller
+ */
+ssd1306_handle_t
+ssd1306_alloc(ssd1306_model model, int flags)
+{
+	ssd1306_handle_t h;
+
+	h = calloc(1, sizeof *h);
+	if (h == NULL)
+		return (SSD1306_INVALID_HANDLE);
+
+	if ((model < 0) || (model >= SSD1306_NMODELS) ||
+	    (ssd1306_models[model].width == 0)) {
+		free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+
+	h->model = model;
+	h->desc = &ssd1306_models[model];
+	h->width = h->desc->width;
+	h->height = h->desc->height;
+	h->vccstate = SSD1306_SWITCHCAPVCC;
+	h->font = SSD1306_FONT_16;
+	h->flags = flags;
+	h->regs.dc = -1;
+	ssd1306_regs_invalidate(h);
+
+	h->pages = h->height / 8;
+	h->fb_size = h->width * h->pages;
+	h->scratch_size = h->fb_size;
+	h->fb = calloc(1, h->fb_size);
+	h->scratch = malloc(h->scratch_size);
+	h->shadow = malloc(h->fb_size);
+	h->shadow_valid = 0;
+	h->dirty = malloc(h->pages * sizeof(*h->dirty));
+	if ((h->fb == NULL) || (h->scratch == NULL) ||
+	    (h->shadow == NULL) || (h->dirty == NULL)) {
+		ssd1306_free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+	ssd1306_dirty_reset(h);
+	ssd1306_dirty_all(h);
+
+	return (h);
+}
+
+void
+ssd1306_free(ssd1306_handle_t h)
+{
+
+	free(h->fb);
+	free(h->scratch);
+	free(h->shadow);
+	free(h->dirty);
+	free(h);
+}
+
+void
+ssd1306_close(ssd1306_handle_t h)
+{
+
+	if (h->async != NULL)
+		ssd1306_async_stop(h);
+	if (h->shm != NULL)
+		ssd1306_shm_destroy(h);
+	if (h->ops != NULL)
+		h->ops->close(h);
+	ssd1306_free(h);
+}
+
+/*
+ * Build init sequence for the handle's model and flags, returns its length
+ */
+static int
+ssd1306_init_seq(ssd1306_handle_t h, uint8_t *seq)
+{
+	const struct ssd1306_model_desc *desc;
+	int len, vcc;
+
+	/* Display is left off and horizontal addressing mode is used */
+	desc = h->desc;
+	vcc = h->vccstate;
+	len = 0;
+	seq[len++] = SSD1306_DISPLAYOFF;
+	seq[len++] = SSD1306_SETDISPLAYCLOCKDIV;
+	seq[len++] = 0x80;	/* the suggested ratio 0x80 */
+	seq[len++] = SSD1306_SETMULTIPLEX;
+	seq[len++] = desc->multiplex;
+	seq[len++] = SSD1306_SETDISPLAYOFFSET;
+	seq[len++] = 0x0;	/* no offset */
+	seq[len++] = SSD1306_SETSTARTLINE | 0x0;	/* line #0 */
+	seq[len++] = SSD1306_CHARGEPUMP;
+	seq[len++] = ssd1306_chargepump[vcc];
+	seq[len++] = SSD1306_MEMORYMODE;
+	seq[len++] = 0x00;	/* 0x0 act like ks0108 */
+	seq[len++] = SSD1306_SEGREMAP | 0x1;
+	seq[len++] = SSD1306_COMSCANDEC;
+	seq[len++] = SSD1306_SETCOMPINS;
+	seq[len++] = desc->compins;
+	seq[len++] = SSD1306_SETCONTRAST;
+	seq[len++] = desc->contrast[vcc];
+	seq[len++] = SSD1306_SETPRECHARGE;
+	seq[len++] = ssd1306_precharge[vcc];
+	seq[len++] = SSD1306_SETVCOMDETECT;
+	seq[len++] = 0x40;
+	seq[len++] = SSD1306_DISPLAYALLON_RESUME;
+	seq[len++] = (h->flags & SSD1306_FLAG_INVERSE) ?
+	    SSD1306_INVERTDISPLAY : SSD1306_NORMALDISPLAY;
+	/* Init sequence sets line #0, it differs when rotated */
+	seq[len++] = SSD1306_SETSTARTLINE | ssd1306_ram_line(h, 0);
+
+	return (len);
+}
+
+static void ssd1306_state_forget(ssd1306_handle_t h, const char *path);
+
+int
+ssd1306_initialize(ssd1306_handle_t h)
+{
+	uint8_t seq[CMDBUF_SIZE];
+	int len;
+
+	/* Canvas has no controller to initialize */
+	if (h->desc == NULL)
+		return (-1);
+	/* Record of what was there before no longer holds */
+	ssd1306_state_forget(h, SSD1306_STATE_FILE);
+	ssd1306_regs_invalidate(h);
+	h->ram_offset = 0;
+	len = ssd1306_init_seq(h, seq);
+
+	if (ssd1306_reset(h))
+		return (-1);
+	if (ssd1306_commands(h, seq, len))
+		return (-1);
+
+	/* Registers set by the init sequence */
+	h->regs.display_on = 0;
+	h->regs.contrast = h->desc->contrast[h->vccstate];
+	h->regs.inverse = (h->flags & SSD1306_FLAG_INVERSE) ? 1 : 0;
+	h->regs.startline = 0;
+
+	/* Display RAM content is unknown after reset */
+	h->shadow_valid = 0;
+	ssd1306_dirty_all(h);
+
+	return (0);
+}
+
+/*
+ * FNV-1a over transport name and init sequence, changes whenever
+ * the controller would be configured differently
+ */
+static uint32_t
+ssd1306_init_hash(ssd1306_handle_t h)
+{
+	uint8_t seq[CMDBUF_SIZE];
+	const char *p;
+	uint32_t hash;
+	int i, len;
+
+	hash = 2166136261u;
+	for (p = h->ops->name; *p != '\0'; p++)
+		hash = (hash ^ (uint8_t)*p) * 16777619u;
+	len = ssd1306_init_seq(h, seq);
+	for (i = 0; i < len; i++)
+		hash = (hash ^ seq[i]) * 16777619u;
+
+	return (hash);
+}
+
+static void
+ssd1306_state_fill(ssd1306_handle_t h, struct ssd1306_state *st)
+{
+
+	memset(st, 0, sizeof(*st));
+	st->magic = SSD1306_STATE_MAGIC;
+	st->version = SSD1306_STATE_VERSION;
+	st->model = h->model;
+	st->flags = h->flags;
+	st->vccstate = h->vccstate;
+	st->init_hash = ssd1306_init_hash(h);
+	memcpy(st->device, h->device, sizeof(st->device));
+}
+
+static int
+ssd1306_state_read(const char *path, struct ssd1306_state *st)
+{
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return (-1);
+	n = read(fd, st, sizeof(*st));
+	close(fd);
+
+	return (n == sizeof(*st) ? 0 : -1);
+}
+
+/*
+ * Check state record left by previous initialization. Returns 1 if
+ * the controller is known to be configured the way this handle wants it.
+ */
+static int
+ssd1306_state_check(ssd1306_handle_t h, const char *path)
+{
+	struct ssd1306_state st, want;
+
+	if (ssd1306_state_read(path, &st))
+		return (0);
+	ssd1306_state_fill(h, &want);
+
+	return (memcmp(&st, &want, sizeof(st)) == 0);
+}
+
+/*
+ * Replace state record atomically so concurrent readers never see
+ * partially written one
+ */
+static int
+ssd1306_state_save(ssd1306_handle_t h, const char *path)
+{
+	struct ssd1306_state st;
+	char tmp[PATH_MAX];
+	ssize_t n;
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return (-1);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return (-1);
+	ssd1306_state_fill(h, &st);
+	n = write(fd, &st, sizeof(st));
+	close(fd);
+	if ((n != sizeof(st)) || (rename(tmp, path) < 0)) {
+		unlink(tmp);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Remove record left for the panel of h, records of other panels
+ * sharing the file stay
+ */
+static void
+ssd1306_state_forget(ssd1306_handle_t h, const char *path)
+{
+	struct ssd1306_state st;
+
+	if (ssd1306_state_read(path, &st))
+		return;
+	if (strncmp(st.device, h->device, sizeof(st.device)) == 0)
+		unlink(path);
+}
+
+/*
+ * Skip reset and blanking if state record at path says the panel has
+ * already been initialized with the same settings, otherwise do full
+ * initialization and save the record. Returns 1 on warm attach, 0 if
+ * the panel was initialized and -1 on error.
+ */
+int
+ssd1306_initialize_warm(ssd1306_handle_t h, const char *path)
+{
+	uint8_t seq[CMDBUF_SIZE];
+	int len;
+
+	if (h->desc == NULL)
+		return (-1);
+	if (!ssd1306_state_check(h, path)) {
+		if (ssd1306_initialize(h))
+			return (-1);
+		/* Not fatal, next start is just going to be cold again */
+		(void)ssd1306_state_save(h, path);
+		return (0);
+	}
+
+	/*
+	 * Whatever previous user did to the registers is unknown, and
+	 * the panel may have been power cycled meanwhile. Init sequence
+	 * doesn't touch display RAM, so it is sent again to put every
+	 * register back. Display is not turned off on the way, scrolling
+	 * that reset would have stopped is stopped instead.
+	 */
+	ssd1306_regs_invalidate(h);
+	h->ram_offset = 0;
+	len = ssd1306_init_seq(h, seq);
+	seq[0] = SSD1306_DEACTIVATE_SCROLL;
+	if (ssd1306_commands(h, seq, len))
+		return (-1);
+	h->regs.contrast = h->desc->contrast[h->vccstate];
+	h->regs.inverse = (h->flags & SSD1306_FLAG_INVERSE) ? 1 : 0;
+	h->regs.startline = 0;
+
+	/* First refresh overwrites whatever is in display RAM */
+	h->shadow_valid = 0;
+	ssd1306_dirty_all(h);
+
+	return (1);
+}
@@ -26,6 +26,9 @@
 #ifndef __SSD1306_H__
 #define __SSD1306_H__
 
+#include <sys/types.h>
+#include <stdint.h>
+
 typedef enum {
 	SSD1306_EXTERNALVCC,
 	SSD1306_SWITCHCAPVCC
@@ -43,27 +46,137 @@ typedef enum {
 	SSD1306_FONT_16
 } ssd1306_font;
 
+typedef enum {
+	SSD1306_SCROLL_RIGHT,
+	SSD1306_SCROLL_LEFT
+} ssd1306_scroll_dir;
+
 #define	SSD1306_INVALID_HANDLE	NULL
+#define	SSD1306_IIC_DEFAULT_ADDR	0x3C
+
+/* Lines in controller's display RAM, visible or not */
+#define	SSD1306_RAM_HEIGHT	64
 
 #define	SSD1306_FLAG_INVERSE	(1 << 0)
 #define	SSD1306_FLAG_ROTATE	(1 << 1)
 
 typedef struct ssd1306_handle* ssd1306_handle_t;
 
+#define	SSD1306_INVALID_GROUP	NULL
+#define	SSD1306_GROUP_MAX	8
+
+typedef struct ssd1306_group* ssd1306_group_t;
+
+#define	SSD1306_INVALID_PFONT	NULL
+/* Proportional fonts generated by mkfont are installed here */
+#define	SSD1306_FONT_DIR	"/usr/share/ssd1306"
+
+typedef struct ssd1306_pfont* ssd1306_pfont_t;
+
+/*
+ * Refresh latency histogram: bucket n counts refreshes that took
+ * 2^n..2^(n+1)-1 microseconds, first and last buckets also count
+ * everything shorter and longer respectively
+ */
+#define	SSD1306_HIST_BUCKETS	16
+
+struct ssd1306_stats {
+	uint64_t	transfers;	/* writes issued to the transport */
+	uint64_t	bytes;		/* command and data bytes sent */
+	uint64_t	gpio_toggles;	/* DC and reset line changes */
+	uint64_t	refreshes;
+	uint64_t	refreshes_skipped; /* nothing changed, nothing sent */
+	uint64_t	refresh_usec;	/* total time spent in refreshes */
+	uint64_t	refresh_hist[SSD1306_HIST_BUCKETS];
+};
+
+/* Default record of panel initialization for ssd1306_initialize_warm */
+#define	SSD1306_STATE_FILE	"/var/run/ssd1306.state"
+
 ssd1306_handle_t ssd1306_open(const char *spiodev, ssd1306_model model, int gpio_reset_unit,
     int gpio_reset_pin, int gpio_dc_unit, int gpio_dc_pin, int flags);
 void ssd1306_close(ssd1306_handle_t);
+ssd1306_handle_t ssd1306_open_iic(const char *iicdev, int addr,
+    ssd1306_model model, int flags);
+ssd1306_handle_t ssd1306_open_mock(ssd1306_model model, int flags);
+ssd1306_handle_t ssd1306_open_canvas(int width, int height);
 int ssd1306_initialize(ssd1306_handle_t h);
+int ssd1306_initialize_warm(ssd1306_handle_t h, const char *path);
 int ssd1306_on(ssd1306_handle_t h);
 int ssd1306_off(ssd1306_handle_t h);
+int ssd1306_set_contrast(ssd1306_handle_t h, int contrast);
+int ssd1306_set_inverse(ssd1306_handle_t h, int inverse);
+int ssd1306_set_start_line(ssd1306_handle_t h, int line);
+int ssd1306_set_ram_offset(ssd1306_handle_t h, int line);
+int ssd1306_scroll_horizontal(ssd1306_handle_t h, ssd1306_scroll_dir dir,
+    int start_page, int end_page, int interval);
+int ssd1306_scroll_diagonal(ssd1306_handle_t h, ssd1306_scroll_dir dir,
+    int start_page, int end_page, int interval, int vertical_offset);
+int ssd1306_scroll_area(ssd1306_handle_t h, int top, int rows);
+int ssd1306_scroll_start(ssd1306_handle_t h);
+int ssd1306_scroll_stop(ssd1306_handle_t h);
 int ssd1306_refresh(ssd1306_handle_t h);
+int ssd1306_commands(ssd1306_handle_t h, const uint8_t *cmds, int len);
+void ssd1306_get_stats(ssd1306_handle_t h, struct ssd1306_stats *stats);
+void ssd1306_reset_stats(ssd1306_handle_t h);
+int ssd1306_async_start(ssd1306_handle_t h, int max_fps);
+int ssd1306_present(ssd1306_handle_t h);
+void ssd1306_async_stop(ssd1306_handle_t h);
 int ssd1306_width(ssd1306_handle_t h);
 int ssd1306_height(ssd1306_handle_t h);
+int ssd1306_set_font(ssd1306_handle_t h, ssd1306_font font);
 int ssd1306_font_width(ssd1306_handle_t h);
 int ssd1306_font_height(ssd1306_handle_t h);
+int ssd1306_measure(ssd1306_handle_t h, const char *s);
 void ssd1306_clear(ssd1306_handle_t h);
 void ssd1306_putpixel(ssd1306_handle_t h, int x, int y, int v);
 void ssd1306_putchar(ssd1306_handle_t h, int x, int y, unsigned char);
 void ssd1306_putstr(ssd1306_handle_t h, int x, int y, const char *s);
+void ssd1306_hline(ssd1306_handle_t h, int x, int y, int w, int v);
+void ssd1306_vline(ssd1306_handle_t h, int x, int y, int height, int v);
+void ssd1306_rect(ssd1306_handle_t h, int x, int y, int w, int height, int v);
+void ssd1306_fill_rect(ssd1306_handle_t h, int x, int y, int w, int height,
+    int v);
+void ssd1306_line(ssd1306_handle_t h, int x0, int y0, int x1, int y1, int v);
+void ssd1306_circle(ssd1306_handle_t h, int x, int y, int r, int v);
+void ssd1306_fill_circle(ssd1306_handle_t h, int x, int y, int r, int v);
+void ssd1306_blit(ssd1306_handle_t h, int x, int y, const uint8_t *bitmap,
+    const uint8_t *mask, int w, int height);
+void ssd1306_view_canvas(ssd1306_handle_t h, ssd1306_handle_t canvas,
+    int x, int y);
+
+/* Proportional fonts */
+ssd1306_pfont_t ssd1306_pfont_load(const char *path);
+void ssd1306_pfont_free(ssd1306_pfont_t f);
+void ssd1306_set_pfont(ssd1306_handle_t h, ssd1306_pfont_t f);
+
+/* Panels sharing one SPI bus and reset line */
+ssd1306_group_t ssd1306_group_create(int gpio_reset_unit, int gpio_reset_pin,
+    int max_fps);
+int ssd1306_group_reset(ssd1306_group_t g);
+int ssd1306_group_add(ssd1306_group_t g, ssd1306_handle_t h);
+int ssd1306_group_mirror(ssd1306_group_t g, ssd1306_handle_t src,
+    ssd1306_handle_t dst);
+int ssd1306_group_start(ssd1306_group_t g);
+void ssd1306_group_destroy(ssd1306_group_t g);
+
+/* Display daemon and its clients */
+#define	SSD1306D_SOCKET		"/var/run/ssd1306d.sock"
+#define	SSD1306D_SHM		"/ssd1306d"
+/* Clients have to be in the daemon's group by default */
+#define	SSD1306D_MODE		0660
+
+ssd1306_handle_t ssd1306_attach(const char *path);
+int ssd1306_shm_create(ssd1306_handle_t h, const char *name, mode_t mode,
+    gid_t gid);
+int ssd1306_shm_accept(ssd1306_handle_t h, int fd);
+int ssd1306_shm_serve(ssd1306_handle_t h, int fd);
+
+/* I2C transport */
+int ssd1306_iic_set_burst(ssd1306_handle_t h, int burst);
+
+/* In-memory transport */
+const uint8_t *ssd1306_mock_gddram(ssd1306_handle_t h);
+int ssd1306_mock_pixel(ssd1306_handle_t h, int x, int y);
 
 #endif /* __SSD1306_H__ */
@@ -0,0 +1,350 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+#include "ssd1306_async.h"
+
+/*
+ * Asynchronous refresh: application draws into the back buffer and
+ * presents it, background thread picks up the most recent presented
+ * frame and sends it to the controller, no faster than max_fps.
+ * Three buffers are rotated so neither side ever waits for the other:
+ * back one is drawn into, front one is being sent and pending one is
+ * the latest complete frame. Frames presented faster than the panel
+ * can take them are dropped, only the newest one is sent. Panels in a
+ * group share the group scheduler thread instead of having their own.
+ */
+
+#define	ASYNC_NBUFS	3
+#define	ASYNC_IDX_MASK	0x3
+/* Pending buffer holds frame that has not been sent yet */
+#define	ASYNC_FRESH	0x4
+
+struct ssd1306_async {
+	pthread_t	thread;
+	int		threaded;
+	pthread_mutex_t	io_lock;
+	sem_t		wakeup;
+	/* Posted on present, either own semaphore or the group one */
+	sem_t		*wakeup_sem;
+	uint8_t		*bufs[ASYNC_NBUFS];
+	/* Frame buffer allocated by ssd1306_alloc, restored on stop */
+	uint8_t		*orig_fb;
+	int		back;
+	int		front;
+	atomic_int	pending;
+	atomic_int	stop;
+	atomic_int	error;
+	/* Ranges to send, flusher thread only */
+	struct ssd1306_dirty *dirty;
+	struct timespec	period;
+};
+
+void
+ssd1306_async_lock(ssd1306_handle_t h)
+{
+
+	pthread_mutex_lock(&h->async->io_lock);
+}
+
+void
+ssd1306_async_unlock(ssd1306_handle_t h)
+{
+
+	pthread_mutex_unlock(&h->async->io_lock);
+}
+
+void
+ssd1306_async_sleep(struct timespec *deadline, const struct timespec *period)
+{
+
+	if ((period->tv_sec == 0) && (period->tv_nsec == 0))
+		return;
+
+	deadline->tv_sec += period->tv_sec;
+	deadline->tv_nsec += period->tv_nsec;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+	    deadline, NULL) == EINTR)
+		;
+}
+
+void
+ssd1306_async_period(struct timespec *period, int max_fps)
+{
+
+	/* Zero period means frames are sent as fast as they come */
+	period->tv_sec = 0;
+	period->tv_nsec = 0;
+	if (max_fps > 0) {
+		period->tv_sec = 1 / max_fps;
+		period->tv_nsec = (1000000000L / max_fps) % 1000000000L;
+	}
+}
+
+/*
+ * Take the latest presented frame if there is one that has not been
+ * sent yet. It stays valid until the next call.
+ */
+const uint8_t *
+ssd1306_async_take(ssd1306_handle_t h)
+{
+	struct ssd1306_async *a;
+	int p;
+
+	a = h->async;
+	if ((atomic_load(&a->pending) & ASYNC_FRESH) == 0)
+		return (NULL);
+
+	/* Swap the latest frame with the one sent last time */
+	p = atomic_exchange(&a->pending, a->front);
+	a->front = p & ASYNC_IDX_MASK;
+
+	return (a->bufs[a->front]);
+}
+
+/*
+ * Send frame taken from this or, for mirrored panels, other handle
+ */
+int
+ssd1306_async_send(ssd1306_handle_t h, const uint8_t *frame)
+{
+	struct ssd1306_async *a;
+
+	/*
+	 * Frames in between might have been dropped so per-frame
+	 * dirty ranges are of no use here, compare whole frame
+	 * against what controller has instead
+	 */
+	a = h->async;
+	ssd1306_dirty_fill(h, a->dirty);
+	if (ssd1306_send(h, frame, a->dirty)) {
+		atomic_store(&a->error, 1);
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void *
+ssd1306_async_thread(void *arg)
+{
+	ssd1306_handle_t h;
+	struct ssd1306_async *a;
+	struct timespec deadline;
+	const uint8_t *frame;
+	int stop;
+
+	h = arg;
+	a = h->async;
+	for (;;) {
+		while (sem_wait(&a->wakeup) && (errno == EINTR))
+			;
+		stop = atomic_load(&a->stop);
+		frame = ssd1306_async_take(h);
+		if (frame == NULL) {
+			if (stop)
+				break;
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		ssd1306_async_send(h, frame);
+
+		/* Last presented frame is out, nothing to wait for */
+		if (stop)
+			break;
+		ssd1306_async_sleep(&deadline, &a->period);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Switch handle to triple buffering, frames are sent by whoever
+ * waits on wakeup: own thread or group scheduler
+ */
+int
+ssd1306_async_attach(ssd1306_handle_t h, sem_t *wakeup)
+{
+	struct ssd1306_async *a;
+	pthread_mutexattr_t attr;
+	int i;
+
+	if ((h->desc == NULL) || (h->async != NULL))
+		return (-1);
+
+	a = calloc(1, sizeof(*a));
+	if (a == NULL)
+		return (-1);
+	a->dirty = malloc(h->pages * sizeof(*a->dirty));
+	a->orig_fb = h->fb;
+	a->bufs[0] = h->fb;
+	for (i = 1; i < ASYNC_NBUFS; i++)
+		a->bufs[i] = malloc(h->fb_size);
+	if ((a->dirty == NULL) || (a->bufs[1] == NULL) || (a->bufs[2] == NULL))
+		goto fail;
+	/* Controller content is unknown to the flusher until it sends one */
+	for (i = 1; i < ASYNC_NBUFS; i++)
+		memcpy(a->bufs[i], h->fb, h->fb_size);
+
+	a->back = 0;
+	a->front = 1;
+	atomic_init(&a->pending, 2);
+	atomic_init(&a->stop, 0);
+	atomic_init(&a->error, 0);
+
+	if (sem_init(&a->wakeup, 0, 0))
+		goto fail;
+	a->wakeup_sem = (wakeup != NULL) ? wakeup : &a->wakeup;
+	pthread_mutexattr_init(&attr);
+	/* Flusher sends commands while holding the lock */
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (pthread_mutex_init(&a->io_lock, &attr)) {
+		pthread_mutexattr_destroy(&attr);
+		sem_destroy(&a->wakeup);
+		goto fail;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	h->async = a;
+
+	return (0);
+
+fail:
+	for (i = 1; i < ASYNC_NBUFS; i++)
+		free(a->bufs[i]);
+	free(a->dirty);
+	free(a);
+	return (-1);
+}
+
+/*
+ * Back to synchronous mode, whoever was sending frames is gone by now
+ */
+void
+ssd1306_async_detach(ssd1306_handle_t h)
+{
+	struct ssd1306_async *a;
+	int i;
+
+	a = h->async;
+	h->async = NULL;
+
+	/*
+	 * Flusher has sent the last presented frame. Keep what
+	 * application has drawn since, it gets sent by next refresh
+	 */
+	if (h->fb != a->orig_fb) {
+		memcpy(a->orig_fb, h->fb, h->fb_size);
+		h->fb = a->orig_fb;
+	}
+	ssd1306_dirty_fill(h, h->dirty);
+
+	pthread_mutex_destroy(&a->io_lock);
+	sem_destroy(&a->wakeup);
+	for (i = 0; i < ASYNC_NBUFS; i++)
+		if (a->bufs[i] != a->orig_fb)
+			free(a->bufs[i]);
+	free(a->dirty);
+	free(a);
+}
+
+int
+ssd1306_async_start(ssd1306_handle_t h, int max_fps)
+{
+	struct ssd1306_async *a;
+
+	if (max_fps < 0)
+		return (-1);
+	if (ssd1306_async_attach(h, NULL))
+		return (-1);
+
+	a = h->async;
+	ssd1306_async_period(&a->period, max_fps);
+	if (pthread_create(&a->thread, NULL, ssd1306_async_thread, h)) {
+		ssd1306_async_detach(h);
+		return (-1);
+	}
+	a->threaded = 1;
+
+	return (0);
+}
+
+int
+ssd1306_present(ssd1306_handle_t h)
+{
+	struct ssd1306_async *a;
+	int p, prev;
+
+	a = h->async;
+	if (a == NULL)
+		return (ssd1306_refresh(h));
+
+	prev = a->back;
+	p = atomic_exchange(&a->pending, prev | ASYNC_FRESH);
+	a->back = p & ASYNC_IDX_MASK;
+
+	/* Drawing continues on top of the presented frame */
+	memcpy(a->bufs[a->back], a->bufs[prev], h->fb_size);
+	h->fb = a->bufs[a->back];
+	ssd1306_dirty_clean(h, h->dirty);
+	sem_post(a->wakeup_sem);
+
+	/* Report failure of the frame sent earlier */
+	if (atomic_exchange(&a->error, 0))
+		return (-1);
+
+	return (0);
+}
+
+void
+ssd1306_async_stop(ssd1306_handle_t h)
+{
+	struct ssd1306_async *a;
+
+	a = h->async;
+	/* Group members are released by ssd1306_group_destroy */
+	if ((a == NULL) || !a->threaded)
+		return;
+
+	atomic_store(&a->stop, 1);
+	sem_post(&a->wakeup);
+	pthread_join(a->thread, NULL);
+	ssd1306_async_detach(h);
+}
@@ -0,0 +1,136 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+
+/*
+ * Off-screen canvas: handle with a frame buffer of arbitrary size and
+ * no display behind it. All drawing functions work on it, visible part
+ * is then copied to the display frame buffer by ssd1306_view_canvas, so
+ * scrolling through content rendered once costs only the copy.
+ */
+
+static int
+ssd1306_canvas_write(ssd1306_handle_t h __unused, int dc __unused,
+    uint8_t *data __unused, int len __unused)
+{
+
+	/* Nothing to send data to */
+	return (-1);
+}
+
+static void
+ssd1306_canvas_close(ssd1306_handle_t h __unused)
+{
+}
+
+static const struct ssd1306_transport ssd1306_canvas_transport = {
+	.name = "canvas",
+	.write = ssd1306_canvas_write,
+	.close = ssd1306_canvas_close,
+};
+
+ssd1306_handle_t
+ssd1306_open_canvas(int width, int height)
+{
+	ssd1306_handle_t h;
+
+	if ((width <= 0) || (height <= 0))
+		return (SSD1306_INVALID_HANDLE);
+
+	h = calloc(1, sizeof *h);
+	if (h == NULL)
+		return (SSD1306_INVALID_HANDLE);
+
+	h->ops = &ssd1306_canvas_transport;
+	h->width = width;
+	h->height = height;
+	h->font = SSD1306_FONT_16;
+	h->pages = (height + 7) / 8;
+	h->fb_size = h->width * h->pages;
+	h->fb = calloc(1, h->fb_size);
+	h->dirty = malloc(h->pages * sizeof(*h->dirty));
+	if ((h->fb == NULL) || (h->dirty == NULL)) {
+		ssd1306_free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+	ssd1306_dirty_clean(h, h->dirty);
+
+	return (h);
+}
+
+/*
+ * Copy window of the canvas with top left corner at (x, y) into the
+ * frame buffer of h, area outside of the canvas is blank. Only columns
+ * that change are marked dirty.
+ */
+void
+ssd1306_view_canvas(ssd1306_handle_t h, ssd1306_handle_t canvas, int x, int y)
+{
+	const uint8_t *lo, *hi;
+	uint8_t *dst, b;
+	int page, row, cpage, shift, col, cx;
+	int first, last;
+
+	for (page = 0; page < h->pages; page++) {
+		/* Display page is made of bits from two canvas pages */
+		row = y + page * 8;
+		cpage = (row >= 0) ? row / 8 : -((7 - row) / 8);
+		shift = row - cpage * 8;
+		lo = (cpage >= 0 && cpage < canvas->pages) ?
+		    canvas->fb + cpage * canvas->width : NULL;
+		hi = (shift != 0 && cpage + 1 >= 0 &&
+		    cpage + 1 < canvas->pages) ?
+		    canvas->fb + (cpage + 1) * canvas->width : NULL;
+
+		dst = h->fb + page * h->width;
+		first = h->width;
+		last = -1;
+		for (col = 0; col < h->width; col++) {
+			cx = x + col;
+			b = 0;
+			if ((cx >= 0) && (cx < canvas->width)) {
+				if (lo != NULL)
+					b = lo[cx] >> shift;
+				if (hi != NULL)
+					b |= hi[cx] << (8 - shift);
+			}
+			if (dst[col] != b) {
+				dst[col] = b;
+				if (first > col)
+					first = col;
+				last = col;
+			}
+		}
+
+		if (last >= 0)
+			ssd1306_dirty_mark(h, page, first, last);
+	}
+}
@@ -0,0 +1,268 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+
+/*
+ * Drawing primitives. Fills work on whole page bytes: every page
+ * covered by the area gets one mask and the span of columns is either
+ * memset or masked in one pass, so filled areas cost about the same as
+ * their size in bytes rather than in pixels.
+ */
+
+/* Clip rectangle to the frame buffer, return 0 if nothing is left */
+static int
+ssd1306_clip(ssd1306_handle_t h, int *x, int *y, int *w, int *hh)
+{
+
+	if (*x < 0) {
+		*w += *x;
+		*x = 0;
+	}
+	if (*y < 0) {
+		*hh += *y;
+		*y = 0;
+	}
+	if (*x + *w > h->width)
+		*w = h->width - *x;
+	if (*y + *hh > h->height)
+		*hh = h->height - *y;
+
+	return ((*w > 0) && (*hh > 0));
+}
+
+void
+ssd1306_fill_rect(ssd1306_handle_t h, int x, int y, int w, int hh, int v)
+{
+	int page, p0, p1, c;
+	uint8_t m, *p;
+
+	if (!ssd1306_clip(h, &x, &y, &w, &hh))
+		return;
+
+	p0 = y / 8;
+	p1 = (y + hh - 1) / 8;
+	for (page = p0; page <= p1; page++) {
+		m = 0xff;
+		if (page == p0)
+			m &= 0xff << (y % 8);
+		if (page == p1)
+			m &= 0xff >> (7 - (y + hh - 1) % 8);
+		p = h->fb + page * h->width + x;
+		if (m == 0xff)
+			memset(p, v ? 0xff : 0, w);
+		else if (v) {
+			for (c = 0; c < w; c++)
+				p[c] |= m;
+		} else {
+			for (c = 0; c < w; c++)
+				p[c] &= ~m;
+		}
+		ssd1306_dirty_mark(h, page, x, x + w - 1);
+	}
+}
+
+void
+ssd1306_hline(ssd1306_handle_t h, int x, int y, int w, int v)
+{
+
+	ssd1306_fill_rect(h, x, y, w, 1, v);
+}
+
+void
+ssd1306_vline(ssd1306_handle_t h, int x, int y, int hh, int v)
+{
+
+	ssd1306_fill_rect(h, x, y, 1, hh, v);
+}
+
+void
+ssd1306_rect(ssd1306_handle_t h, int x, int y, int w, int hh, int v)
+{
+
+	if ((w <= 0) || (hh <= 0))
+		return;
+	ssd1306_hline(h, x, y, w, v);
+	ssd1306_hline(h, x, y + hh - 1, w, v);
+	ssd1306_vline(h, x, y + 1, hh - 2, v);
+	ssd1306_vline(h, x + w - 1, y + 1, hh - 2, v);
+}
+
+/*
+ * Bresenham line between (x0, y0) and (x1, y1), both ends included.
+ * Horizontal and vertical lines are drawn as spans.
+ */
+void
+ssd1306_line(ssd1306_handle_t h, int x0, int y0, int x1, int y1, int v)
+{
+	int dx, dy, sx, sy, err, e2;
+
+	if (y0 == y1) {
+		ssd1306_hline(h, x0 < x1 ? x0 : x1, y0, abs(x1 - x0) + 1, v);
+		return;
+	}
+	if (x0 == x1) {
+		ssd1306_vline(h, x0, y0 < y1 ? y0 : y1, abs(y1 - y0) + 1, v);
+		return;
+	}
+
+	dx = abs(x1 - x0);
+	dy = -abs(y1 - y0);
+	sx = (x0 < x1) ? 1 : -1;
+	sy = (y0 < y1) ? 1 : -1;
+	err = dx + dy;
+	for (;;) {
+		ssd1306_putpixel(h, x0, y0, v);
+		if ((x0 == x1) && (y0 == y1))
+			break;
+		e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+/* Midpoint circle with center at (cx, cy) */
+void
+ssd1306_circle(ssd1306_handle_t h, int cx, int cy, int r, int v)
+{
+	int x, y, err;
+
+	if (r < 0)
+		return;
+
+	x = r;
+	y = 0;
+	err = 1 - r;
+	while (x >= y) {
+		ssd1306_putpixel(h, cx + x, cy + y, v);
+		ssd1306_putpixel(h, cx - x, cy + y, v);
+		ssd1306_putpixel(h, cx + x, cy - y, v);
+		ssd1306_putpixel(h, cx - x, cy - y, v);
+		ssd1306_putpixel(h, cx + y, cy + x, v);
+		ssd1306_putpixel(h, cx - y, cy + x, v);
+		ssd1306_putpixel(h, cx + y, cy - x, v);
+		ssd1306_putpixel(h, cx - y, cy - x, v);
+		y++;
+		if (err < 0)
+			err += 2 * y + 1;
+		else {
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+	}
+}
+
+/* Filled circle, drawn as horizontal spans */
+void
+ssd1306_fill_circle(ssd1306_handle_t h, int cx, int cy, int r, int v)
+{
+	int x, y, err;
+
+	if (r < 0)
+		return;
+
+	x = r;
+	y = 0;
+	err = 1 - r;
+	while (x >= y) {
+		ssd1306_hline(h, cx - x, cy + y, 2 * x + 1, v);
+		ssd1306_hline(h, cx - x, cy - y, 2 * x + 1, v);
+		ssd1306_hline(h, cx - y, cy + x, 2 * y + 1, v);
+		ssd1306_hline(h, cx - y, cy - x, 2 * y + 1, v);
+		y++;
+		if (err < 0)
+			err += 2 * y + 1;
+		else {
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+	}
+}
+
+/*
+ * Copy w x hh bitmap to (x, y). Bitmap is in page format, the same as
+ * the frame buffer: (hh + 7) / 8 bands of w column bytes each, bit 0 is
+ * the topmost pixel. Only pixels set in mask, laid out the same way,
+ * are modified; NULL mask copies the whole bitmap.
+ */
+void
+ssd1306_blit(ssd1306_handle_t h, int x, int y, const uint8_t *bitmap,
+    const uint8_t *mask, int w, int hh)
+{
+	const uint8_t *bits, *bmask;
+	int band, bands, cy, c, c0, c1, page, shift;
+	uint8_t hmask, lo, hi;
+	uint8_t *p;
+
+	if ((w <= 0) || (hh <= 0))
+		return;
+
+	c0 = (x < 0) ? -x : 0;
+	c1 = (x + w > h->width) ? h->width - x : w;
+	bands = (hh + 7) / 8;
+	for (band = 0; band < bands; band++) {
+		cy = y + band * 8;
+		bits = bitmap + band * w;
+		hmask = (hh - band * 8 >= 8) ? 0xff : (1 << (hh - band * 8)) - 1;
+		if (mask == NULL) {
+			ssd1306_blit_band(h, x, cy, bits, hmask, w);
+			continue;
+		}
+		if ((cy <= -8) || (cy >= h->height) || (c0 >= c1))
+			continue;
+
+		/* Per-column masks, band is split the same way as above */
+		bmask = mask + band * w;
+		page = (cy + 8) / 8 - 1;
+		shift = cy - page * 8;
+		for (c = c0; c < c1; c++) {
+			lo = (bmask[c] & hmask) << shift;
+			hi = (shift != 0) ? (bmask[c] & hmask) >> (8 - shift) : 0;
+			if (page >= 0) {
+				p = h->fb + page * h->width + x + c;
+				*p = (*p & ~lo) | ((bits[c] << shift) & lo);
+			}
+			if (page + 1 < h->pages) {
+				p = h->fb + (page + 1) * h->width + x + c;
+				*p = (*p & ~hi) | ((bits[c] >> (8 - shift)) & hi);
+			}
+		}
+		if (page >= 0)
+			ssd1306_dirty_mark(h, page, x + c0, x + c1 - 1);
+		if ((shift != 0) && (page + 1 < h->pages))
+			ssd1306_dirty_mark(h, page + 1, x + c0, x + c1 - 1);
+	}
+}
@@ -0,0 +1,317 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Proportional fonts loaded from files generated by mkfont
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+#include "ssd1306_font.h"
+
+/* Fonts for 64-line panels are way smaller than this */
+#define	PFONT_MAX_SIZE	(256 * 1024)
+
+struct ssd1306_pfont {
+	int		height;
+	int		first;
+	int		count;
+	int		nkern;
+	int		max_advance;
+	struct ssd1306_font_glyph *glyphs;
+	struct ssd1306_font_kern *kern;
+	uint8_t		*bitmap;
+};
+
+static uint16_t
+rd16(const uint8_t *p)
+{
+
+	return (p[0] | (p[1] << 8));
+}
+
+static uint32_t
+rd32(const uint8_t *p)
+{
+
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+/*
+ * Convert file image into native structures, validating every glyph
+ * against the bitmap size so drawing needs no further checks
+ */
+static ssd1306_pfont_t
+ssd1306_pfont_parse(const uint8_t *data, size_t size)
+{
+	struct ssd1306_pfont *f;
+	const uint8_t *p;
+	uint32_t bitmap_size;
+	size_t need;
+	int i, bands, count, nkern, height, prev, key;
+
+	if (size < SSD1306_FONT_HDR_SIZE)
+		return (SSD1306_INVALID_PFONT);
+	if ((rd32(data) != SSD1306_FONT_MAGIC) ||
+	    (data[4] != SSD1306_FONT_VERSION))
+		return (SSD1306_INVALID_PFONT);
+	height = data[5];
+	count = rd16(data + 8);
+	nkern = rd16(data + 10);
+	bitmap_size = rd32(data + 12);
+	if ((height == 0) || (height > SSD1306_RAM_HEIGHT) ||
+	    (data[6] + count > 256))
+		return (SSD1306_INVALID_PFONT);
+	need = SSD1306_FONT_HDR_SIZE + count * SSD1306_FONT_GLYPH_SIZE +
+	    nkern * SSD1306_FONT_KERN_SIZE + bitmap_size;
+	if (need != size)
+		return (SSD1306_INVALID_PFONT);
+
+	f = malloc(sizeof(*f) + count * sizeof(f->glyphs[0]) +
+	    nkern * sizeof(f->kern[0]) + bitmap_size);
+	if (f == NULL)
+		return (SSD1306_INVALID_PFONT);
+	f->height = height;
+	f->first = data[6];
+	f->count = count;
+	f->nkern = nkern;
+	f->max_advance = 0;
+	f->glyphs = (struct ssd1306_font_glyph *)(f + 1);
+	f->kern = (struct ssd1306_font_kern *)(f->glyphs + count);
+	f->bitmap = (uint8_t *)(f->kern + nkern);
+
+	bands = (height + 7) / 8;
+	p = data + SSD1306_FONT_HDR_SIZE;
+	for (i = 0; i < count; i++, p += SSD1306_FONT_GLYPH_SIZE) {
+		f->glyphs[i].offset = rd16(p);
+		f->glyphs[i].width = p[2];
+		f->glyphs[i].advance = p[3];
+		if ((uint32_t)(f->glyphs[i].offset + bands * p[2]) >
+		    bitmap_size)
+			goto fail;
+		if (p[3] > f->max_advance)
+			f->max_advance = p[3];
+	}
+	/* Lookup relies on pairs being sorted */
+	prev = -1;
+	for (i = 0; i < nkern; i++, p += SSD1306_FONT_KERN_SIZE) {
+		f->kern[i].left = p[0];
+		f->kern[i].right = p[1];
+		f->kern[i].adjust = (int8_t)p[2];
+		key = (p[0] << 8) | p[1];
+		if (key <= prev)
+			goto fail;
+		prev = key;
+	}
+	memcpy(f->bitmap, p, bitmap_size);
+
+	return (f);
+fail:
+	free(f);
+	return (SSD1306_INVALID_PFONT);
+}
+
+ssd1306_pfont_t
+ssd1306_pfont_load(const char *path)
+{
+	ssd1306_pfont_t f;
+	struct stat st;
+	uint8_t *data;
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return (SSD1306_INVALID_PFONT);
+	if ((fstat(fd, &st) < 0) || (st.st_size > PFONT_MAX_SIZE) ||
+	    ((data = malloc(st.st_size)) == NULL)) {
+		close(fd);
+		return (SSD1306_INVALID_PFONT);
+	}
+	n = read(fd, data, st.st_size);
+	close(fd);
+	f = (n == st.st_size) ? ssd1306_pfont_parse(data, n) :
+	    SSD1306_INVALID_PFONT;
+	free(data);
+
+	return (f);
+}
+
+void
+ssd1306_pfont_free(ssd1306_pfont_t f)
+{
+
+	free(f);
+}
+
+/*
+ * Font has to outlive the handle or be replaced before it's freed,
+ * NULL switches back to the fixed-width font
+ */
+void
+ssd1306_set_pfont(ssd1306_handle_t h, ssd1306_pfont_t f)
+{
+
+	h->pfont = f;
+}
+
+static const struct ssd1306_font_glyph *
+ssd1306_pfont_glyph(ssd1306_pfont_t f, unsigned char c)
+{
+
+	if ((c < f->first) || (c >= f->first + f->count))
+		return (NULL);
+	return (&f->glyphs[c - f->first]);
+}
+
+static int
+ssd1306_pfont_kern(ssd1306_pfont_t f, unsigned char left, unsigned char right)
+{
+	int lo, hi, mid, key, k;
+
+	key = (left << 8) | right;
+	lo = 0;
+	hi = f->nkern - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		k = (f->kern[mid].left << 8) | f->kern[mid].right;
+		if (k == key)
+			return (f->kern[mid].adjust);
+		if (k < key)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return (0);
+}
+
+int
+ssd1306_pfont_width(ssd1306_pfont_t f)
+{
+
+	return (f->max_advance);
+}
+
+int
+ssd1306_pfont_height(ssd1306_pfont_t f)
+{
+
+	return (f->height);
+}
+
+/*
+ * Columns covered by the string: pen position of the last glyph
+ * plus its width, trailing spacing is not included
+ */
+static int
+ssd1306_pfont_measure(ssd1306_pfont_t f, const char *s)
+{
+	const struct ssd1306_font_glyph *g;
+	int pen, end;
+	unsigned char c, prev;
+
+	pen = end = 0;
+	prev = 0;
+	for (; *s != '\0'; s++) {
+		c = *s;
+		if ((g = ssd1306_pfont_glyph(f, c)) == NULL)
+			continue;
+		if (prev != 0)
+			pen += ssd1306_pfont_kern(f, prev, c);
+		if (pen + g->width > end)
+			end = pen + g->width;
+		pen += g->advance;
+		prev = c;
+	}
+
+	return (end);
+}
+
+int
+ssd1306_measure(ssd1306_handle_t h, const char *s)
+{
+
+	if (h->pfont != NULL)
+		return (ssd1306_pfont_measure(h->pfont, s));
+	return (strlen(s) * ssd1306_font_width(h));
+}
+
+/*
+ * Glyph ink is drawn over whatever is there, kerned neighbours may
+ * share columns
+ */
+static void
+ssd1306_pfont_draw(ssd1306_handle_t h, int x, int y,
+    const struct ssd1306_font_glyph *g)
+{
+	const uint8_t *bits;
+
+	bits = h->pfont->bitmap + g->offset;
+	ssd1306_blit(h, x, y, bits, bits, g->width, h->pfont->height);
+}
+
+int
+ssd1306_pfont_putchar(ssd1306_handle_t h, int x, int y, unsigned char c)
+{
+	const struct ssd1306_font_glyph *g;
+
+	if ((g = ssd1306_pfont_glyph(h->pfont, c)) == NULL)
+		return (0);
+	ssd1306_fill_rect(h, x, y, g->advance, h->pfont->height, 0);
+	ssd1306_pfont_draw(h, x, y, g);
+
+	return (g->advance);
+}
+
+void
+ssd1306_pfont_putstr(ssd1306_handle_t h, int x, int y, const char *s)
+{
+	const struct ssd1306_font_glyph *g;
+	ssd1306_pfont_t f;
+	unsigned char c, prev;
+
+	f = h->pfont;
+	/* Background is cleared once so kerning can't erase ink */
+	ssd1306_fill_rect(h, x, y, ssd1306_pfont_measure(f, s), f->height, 0);
+	prev = 0;
+	for (; (*s != '\0') && (x < h->width); s++) {
+		c = *s;
+		if ((g = ssd1306_pfont_glyph(f, c)) == NULL)
+			continue;
+		if (prev != 0)
+			x += ssd1306_pfont_kern(f, prev, c);
+		ssd1306_pfont_draw(h, x, y, g);
+		x += g->advance;
+		prev = c;
+	}
+}
@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __SSD1306_FONT_H__
+#define __SSD1306_FONT_H__
+
+#include <stdint.h>
+
+/*
+ * Proportional font file, shared by the library and mkfont. All
+ * multi-byte fields are little-endian.
+ *
+ *	header		struct ssd1306_font_hdr
+ *	glyphs		count x struct ssd1306_font_glyph
+ *	kerning		nkern x struct ssd1306_font_kern, sorted by pair
+ *	bitmaps		glyph columns in page format, a band of 8 rows
+ *			after another, width bytes per band
+ */
+
+#define	SSD1306_FONT_MAGIC	0x314e4653	/* "SFN1" */
+#define	SSD1306_FONT_VERSION	1
+
+struct ssd1306_font_hdr {
+	uint32_t	magic;
+	uint8_t		version;
+	uint8_t		height;
+	uint8_t		first;		/* code of the first glyph */
+	uint8_t		reserved;
+	uint16_t	count;
+	uint16_t	nkern;
+	uint32_t	bitmap_size;
+};
+
+struct ssd1306_font_glyph {
+	uint16_t	offset;		/* into bitmaps */
+	uint8_t		width;		/* columns in the bitmap */
+	uint8_t		advance;	/* pen movement after the glyph */
+};
+
+/* Pen adjustment between two glyphs, usually negative */
+struct ssd1306_font_kern {
+	uint8_t		left;
+	uint8_t		right;
+	int8_t		adjust;
+	uint8_t		reserved;
+};
+
+#define	SSD1306_FONT_HDR_SIZE	16
+#define	SSD1306_FONT_GLYPH_SIZE	4
+#define	SSD1306_FONT_KERN_SIZE	4
+
+#endif /* __SSD1306_FONT_H__ */
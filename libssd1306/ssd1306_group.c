@@ -0,0 +1,287 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <libgpio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+#include "ssd1306_async.h"
+
+/*
+ * Several panels on one bus: they share reset line, each has its own
+ * chip select and DC line. Frames presented on member handles are sent
+ * by single scheduler thread which serves panels round-robin, one frame
+ * per panel per pass, so a busy panel can't starve the others. A panel
+ * can mirror another one and then shows frames presented on that one.
+ */
+
+struct ssd1306_group_member {
+	ssd1306_handle_t h;
+	/* Index of the panel this one mirrors, -1 if none */
+	int		mirror;
+};
+
+struct ssd1306_group {
+	gpio_handle_t	gpio;
+	int		reset_pin;
+	struct ssd1306_group_member members[SSD1306_GROUP_MAX];
+	int		nmembers;
+	/* First panel to serve in the next pass */
+	int		next;
+	sem_t		wakeup;
+	pthread_t	thread;
+	int		running;
+	atomic_int	stop;
+	struct timespec	period;
+};
+
+static int
+ssd1306_group_find(ssd1306_group_t g, ssd1306_handle_t h)
+{
+	int i;
+
+	for (i = 0; i < g->nmembers; i++)
+		if (g->members[i].h == h)
+			return (i);
+
+	return (-1);
+}
+
+/*
+ * Serve every panel with a pending frame once, return number of frames
+ * sent
+ */
+static int
+ssd1306_group_pass(ssd1306_group_t g)
+{
+	struct ssd1306_group_member *m;
+	const uint8_t *frame;
+	int i, j, k, sent;
+
+	sent = 0;
+	for (k = 0; k < g->nmembers; k++) {
+		i = (g->next + k) % g->nmembers;
+		m = &g->members[i];
+		if (m->mirror >= 0)
+			continue;
+		frame = ssd1306_async_take(m->h);
+		if (frame == NULL)
+			continue;
+		ssd1306_async_send(m->h, frame);
+		for (j = 0; j < g->nmembers; j++)
+			if (g->members[j].mirror == i)
+				ssd1306_async_send(g->members[j].h, frame);
+		sent++;
+	}
+	g->next = (g->next + 1) % g->nmembers;
+
+	return (sent);
+}
+
+static void *
+ssd1306_group_thread(void *arg)
+{
+	ssd1306_group_t g;
+	struct timespec deadline;
+	int stop;
+
+	g = arg;
+	for (;;) {
+		while (sem_wait(&g->wakeup) && (errno == EINTR))
+			;
+		stop = atomic_load(&g->stop);
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		/* Frames presented while sending are picked up right away */
+		while (ssd1306_group_pass(g) > 0) {
+			if (stop)
+				continue;
+			ssd1306_async_sleep(&deadline, &g->period);
+		}
+		if (stop)
+			break;
+	}
+
+	return (NULL);
+}
+
+ssd1306_group_t
+ssd1306_group_create(int gpio_reset_unit, int gpio_reset_pin, int max_fps)
+{
+	ssd1306_group_t g;
+
+	if (max_fps < 0)
+		return (SSD1306_INVALID_GROUP);
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL)
+		return (SSD1306_INVALID_GROUP);
+
+	if (sem_init(&g->wakeup, 0, 0)) {
+		free(g);
+		return (SSD1306_INVALID_GROUP);
+	}
+
+	/* Negative reset pin means there is no reset line to drive */
+	g->gpio = GPIO_INVALID_HANDLE;
+	g->reset_pin = gpio_reset_pin;
+	if (gpio_reset_pin >= 0) {
+		g->gpio = gpio_open(gpio_reset_unit);
+		if (g->gpio == GPIO_INVALID_HANDLE) {
+			sem_destroy(&g->wakeup);
+			free(g);
+			return (SSD1306_INVALID_GROUP);
+		}
+		if (gpio_pin_output(g->gpio, gpio_reset_pin)) {
+			gpio_close(g->gpio);
+			sem_destroy(&g->wakeup);
+			free(g);
+			return (SSD1306_INVALID_GROUP);
+		}
+	}
+
+	ssd1306_async_period(&g->period, max_fps);
+	atomic_init(&g->stop, 0);
+
+	return (g);
+}
+
+/*
+ * Reset all panels at once, they have to be initialized afterwards
+ */
+int
+ssd1306_group_reset(ssd1306_group_t g)
+{
+
+	if (g->gpio == GPIO_INVALID_HANDLE)
+		return (0);
+
+	if (gpio_pin_high(g->gpio, g->reset_pin))
+		return (-1);
+	usleep(999);
+	if (gpio_pin_low(g->gpio, g->reset_pin))
+		return (-1);
+	usleep(10000);
+	if (gpio_pin_high(g->gpio, g->reset_pin))
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Add panel to the group, from now on refreshes only hand frames over
+ * to the scheduler
+ */
+int
+ssd1306_group_add(ssd1306_group_t g, ssd1306_handle_t h)
+{
+	struct ssd1306_group_member *m;
+
+	if (g->running || (g->nmembers >= SSD1306_GROUP_MAX))
+		return (-1);
+	if (ssd1306_group_find(g, h) >= 0)
+		return (-1);
+	if (ssd1306_async_attach(h, &g->wakeup))
+		return (-1);
+
+	m = &g->members[g->nmembers++];
+	m->h = h;
+	m->mirror = -1;
+
+	return (0);
+}
+
+/*
+ * Show frames presented on src on dst as well. Panels have to be of
+ * the same size, rotation and other settings are per panel.
+ */
+int
+ssd1306_group_mirror(ssd1306_group_t g, ssd1306_handle_t src,
+    ssd1306_handle_t dst)
+{
+	int j, s, d;
+
+	if (g->running)
+		return (-1);
+
+	s = ssd1306_group_find(g, src);
+	d = ssd1306_group_find(g, dst);
+	if ((s < 0) || (d < 0) || (s == d))
+		return (-1);
+	if (g->members[s].mirror >= 0)
+		return (-1);
+	/* Panels mirroring dst would never get a frame again */
+	for (j = 0; j < g->nmembers; j++)
+		if (g->members[j].mirror == d)
+			return (-1);
+	if ((src->width != dst->width) || (src->height != dst->height))
+		return (-1);
+
+	g->members[d].mirror = s;
+
+	return (0);
+}
+
+int
+ssd1306_group_start(ssd1306_group_t g)
+{
+
+	if (g->running || (g->nmembers == 0))
+		return (-1);
+	if (pthread_create(&g->thread, NULL, ssd1306_group_thread, g))
+		return (-1);
+	g->running = 1;
+
+	return (0);
+}
+
+/*
+ * Send frames that are still pending and release the panels, they are
+ * back to synchronous mode and have to be closed by the caller
+ */
+void
+ssd1306_group_destroy(ssd1306_group_t g)
+{
+	int i;
+
+	if (g->running) {
+		atomic_store(&g->stop, 1);
+		sem_post(&g->wakeup);
+		pthread_join(g->thread, NULL);
+	}
+
+	for (i = 0; i < g->nmembers; i++)
+		ssd1306_async_detach(g->members[i].h);
+	if (g->gpio != GPIO_INVALID_HANDLE)
+		gpio_close(g->gpio);
+	sem_destroy(&g->wakeup);
+	free(g);
+}
@@ -0,0 +1,176 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <dev/iicbus/iic.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+
+/*
+ * iic(4) transport. There is no DC line, every message starts with
+ * control byte telling whether the rest of it is commands or data.
+ * Data is sent as long bursts and all bursts of one transfer go in
+ * single I2CRDWR request, so number of bus transactions per frame is
+ * as low as controller allows.
+ */
+
+#define	IIC_CONTROL_CMD		0x00
+#define	IIC_CONTROL_DATA	0x40
+
+/* Default and maximum payload of one message, without control byte */
+#define	IIC_BURST_DEFAULT	1024
+#define	IIC_BURST_MAX		4096
+
+struct ssd1306_iic_softc {
+	int		fd;
+	uint8_t		addr;
+	int		burst;
+	/* Outgoing messages, each prefixed with control byte */
+	uint8_t		*buf;
+	int		buf_size;
+};
+
+static int
+ssd1306_iic_write(ssd1306_handle_t h, int dc, uint8_t *data, int len)
+{
+	struct ssd1306_iic_softc *sc;
+	struct iic_msg msgs[IIC_RDRW_MAX_MSGS];
+	struct iic_rdwr_data rdwr;
+	uint8_t *p;
+	int chunk, need;
+
+	sc = h->softc;
+	need = len + (len / sc->burst + 1);
+	if (need > sc->buf_size) {
+		p = realloc(sc->buf, need);
+		if (p == NULL)
+			return (-1);
+		sc->buf = p;
+		sc->buf_size = need;
+	}
+
+	p = sc->buf;
+	rdwr.msgs = msgs;
+	rdwr.nmsgs = 0;
+	while (len > 0) {
+		chunk = len < sc->burst ? len : sc->burst;
+		p[0] = dc ? IIC_CONTROL_DATA : IIC_CONTROL_CMD;
+		memcpy(p + 1, data, chunk);
+		msgs[rdwr.nmsgs].slave = sc->addr;
+		msgs[rdwr.nmsgs].flags = IIC_M_WR;
+		msgs[rdwr.nmsgs].len = chunk + 1;
+		msgs[rdwr.nmsgs].buf = p;
+		rdwr.nmsgs++;
+		p += chunk + 1;
+		data += chunk;
+		len -= chunk;
+		if ((rdwr.nmsgs == IIC_RDRW_MAX_MSGS) || (len == 0)) {
+			if (ioctl(sc->fd, I2CRDWR, &rdwr) < 0)
+				return (-1);
+			rdwr.nmsgs = 0;
+		}
+	}
+
+	return (0);
+}
+
+static void
+ssd1306_iic_close(ssd1306_handle_t h)
+{
+	struct ssd1306_iic_softc *sc;
+
+	sc = h->softc;
+	close(sc->fd);
+	free(sc->buf);
+	free(sc);
+}
+
+static const struct ssd1306_transport ssd1306_iic_transport = {
+	.name = "iic",
+	.reset = NULL,
+	.set_dc = NULL,
+	.write = ssd1306_iic_write,
+	.close = ssd1306_iic_close,
+};
+
+ssd1306_handle_t
+ssd1306_open_iic(const char *iicdev, int addr, ssd1306_model model, int flags)
+{
+	ssd1306_handle_t h;
+	struct ssd1306_iic_softc *sc;
+
+	h = ssd1306_alloc(model, flags);
+	if (h == SSD1306_INVALID_HANDLE)
+		return (SSD1306_INVALID_HANDLE);
+
+	sc = calloc(1, sizeof *sc);
+	if (sc == NULL) {
+		ssd1306_free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+
+	sc->fd = open(iicdev, O_RDWR);
+	if (sc->fd < 0) {
+		free(sc);
+		ssd1306_free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+
+	sc->addr = (addr << 1);
+	snprintf(h->device, sizeof(h->device), "%s@0x%02x", iicdev, addr);
+	sc->burst = IIC_BURST_DEFAULT;
+	h->ops = &ssd1306_iic_transport;
+	h->softc = sc;
+
+	return (h);
+}
+
+/*
+ * Limit payload of a single I2C message for controllers that can't
+ * handle long transfers
+ */
+int
+ssd1306_iic_set_burst(ssd1306_handle_t h, int burst)
+{
+	struct ssd1306_iic_softc *sc;
+
+	if (h->ops != &ssd1306_iic_transport)
+		return (-1);
+	if ((burst < 1) || (burst > IIC_BURST_MAX))
+		return (-1);
+
+	sc = h->softc;
+	sc->burst = burst;
+
+	return (0);
+}
@@ -0,0 +1,301 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+
+/*
+ * In-memory transport emulating the controller: commands are decoded
+ * and data is stored into the emulated display RAM the same way the
+ * SSD1306 does it, so rendering and refresh logic can be checked and
+ * measured without hardware. Scrolling is not emulated.
+ */
+
+#define	MOCK_COLUMNS	128
+#define	MOCK_PAGES	8
+
+/* Memory addressing modes, SSD1306_MEMORYMODE argument */
+#define	MOCK_MODE_HORIZONTAL	0
+#define	MOCK_MODE_VERTICAL	1
+#define	MOCK_MODE_PAGE		2
+
+struct ssd1306_mock_softc {
+	uint8_t		ram[MOCK_PAGES * MOCK_COLUMNS];
+	int		mode;
+	/* Write pointer and address window */
+	int		col;
+	int		page;
+	int		col0;
+	int		col1;
+	int		page0;
+	int		page1;
+	int		startline;
+	int		inverse;
+	int		display_on;
+	/* Command being decoded and its arguments */
+	uint8_t		cmd;
+	uint8_t		args[8];
+	int		nargs;
+	int		pending;
+};
+
+static int
+ssd1306_mock_argc(uint8_t cmd)
+{
+
+	switch (cmd) {
+	case SSD1306_MEMORYMODE:
+	case SSD1306_SETCONTRAST:
+	case SSD1306_CHARGEPUMP:
+	case SSD1306_SETMULTIPLEX:
+	case SSD1306_SETDISPLAYOFFSET:
+	case SSD1306_SETDISPLAYCLOCKDIV:
+	case SSD1306_SETPRECHARGE:
+	case SSD1306_SETCOMPINS:
+	case SSD1306_SETVCOMDETECT:
+		return (1);
+	case SSD1306_COLUMNADDR:
+	case SSD1306_PAGEADDR:
+	case SSD1306_SET_VERTICAL_SCROLL_AREA:
+		return (2);
+	case SSD1306_RIGHT_HORIZONTAL_SCROLL:
+	case SSD1306_LEFT_HORIZONTAL_SCROLL:
+		return (6);
+	case SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL:
+	case SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL:
+		return (5);
+	default:
+		return (0);
+	}
+}
+
+static void
+ssd1306_mock_execute(struct ssd1306_mock_softc *sc)
+{
+	uint8_t cmd;
+
+	cmd = sc->cmd;
+	switch (cmd) {
+	case SSD1306_MEMORYMODE:
+		sc->mode = sc->args[0] & 3;
+		break;
+	case SSD1306_COLUMNADDR:
+		sc->col0 = sc->args[0] & (MOCK_COLUMNS - 1);
+		sc->col1 = sc->args[1] & (MOCK_COLUMNS - 1);
+		sc->col = sc->col0;
+		break;
+	case SSD1306_PAGEADDR:
+		sc->page0 = sc->args[0] & (MOCK_PAGES - 1);
+		sc->page1 = sc->args[1] & (MOCK_PAGES - 1);
+		sc->page = sc->page0;
+		break;
+	case SSD1306_DISPLAYON:
+	case SSD1306_DISPLAYOFF:
+		sc->display_on = (cmd == SSD1306_DISPLAYON);
+		break;
+	case SSD1306_NORMALDISPLAY:
+	case SSD1306_INVERTDISPLAY:
+		sc->inverse = (cmd == SSD1306_INVERTDISPLAY);
+		break;
+	default:
+		if ((cmd & 0xC0) == SSD1306_SETSTARTLINE)
+			sc->startline = cmd & 0x3F;
+		else if ((cmd & 0xF8) == SSD1306_SETPAGESTART)
+			sc->page = cmd & 0x07;
+		else if ((cmd & 0xF0) == SSD1306_SETLOWCOLUMN)
+			sc->col = (sc->col & 0xF0) | (cmd & 0x0F);
+		else if ((cmd & 0xF0) == SSD1306_SETHIGHCOLUMN)
+			sc->col = (sc->col & 0x0F) | ((cmd & 0x07) << 4);
+		break;
+	}
+}
+
+static void
+ssd1306_mock_command(struct ssd1306_mock_softc *sc, uint8_t b)
+{
+
+	if (sc->pending) {
+		sc->args[sc->nargs++] = b;
+		if (--sc->pending == 0)
+			ssd1306_mock_execute(sc);
+		return;
+	}
+
+	sc->cmd = b;
+	sc->nargs = 0;
+	sc->pending = ssd1306_mock_argc(b);
+	if (sc->pending == 0)
+		ssd1306_mock_execute(sc);
+}
+
+/*
+ * Store data byte and advance write pointer according to addressing mode
+ */
+static void
+ssd1306_mock_data(struct ssd1306_mock_softc *sc, uint8_t b)
+{
+
+	sc->ram[sc->page * MOCK_COLUMNS + sc->col] = b;
+	switch (sc->mode) {
+	case MOCK_MODE_HORIZONTAL:
+		if (sc->col++ < sc->col1)
+			break;
+		sc->col = sc->col0;
+		if (sc->page++ >= sc->page1)
+			sc->page = sc->page0;
+		break;
+	case MOCK_MODE_VERTICAL:
+		if (sc->page++ < sc->page1)
+			break;
+		sc->page = sc->page0;
+		if (sc->col++ >= sc->col1)
+			sc->col = sc->col0;
+		break;
+	default:
+		/* Page mode wraps within the page */
+		sc->col = (sc->col + 1) & (MOCK_COLUMNS - 1);
+		break;
+	}
+}
+
+static int
+ssd1306_mock_write(ssd1306_handle_t h, int dc, uint8_t *data, int len)
+{
+	struct ssd1306_mock_softc *sc;
+	int i;
+
+	sc = h->softc;
+	for (i = 0; i < len; i++) {
+		if (dc)
+			ssd1306_mock_data(sc, data[i]);
+		else
+			ssd1306_mock_command(sc, data[i]);
+	}
+
+	return (0);
+}
+
+static int
+ssd1306_mock_reset(ssd1306_handle_t h)
+{
+	struct ssd1306_mock_softc *sc;
+
+	/* Power-on state, RAM content is kept as is */
+	sc = h->softc;
+	sc->mode = MOCK_MODE_PAGE;
+	sc->col = sc->col0 = 0;
+	sc->page = sc->page0 = 0;
+	sc->col1 = MOCK_COLUMNS - 1;
+	sc->page1 = MOCK_PAGES - 1;
+	sc->startline = 0;
+	sc->inverse = 0;
+	sc->display_on = 0;
+	sc->pending = 0;
+
+	return (0);
+}
+
+static void
+ssd1306_mock_close(ssd1306_handle_t h)
+{
+
+	free(h->softc);
+}
+
+static const struct ssd1306_transport ssd1306_mock_transport = {
+	.name = "mock",
+	.reset = ssd1306_mock_reset,
+	.set_dc = NULL,
+	.write = ssd1306_mock_write,
+	.close = ssd1306_mock_close,
+};
+
+ssd1306_handle_t
+ssd1306_open_mock(ssd1306_model model, int flags)
+{
+	ssd1306_handle_t h;
+	struct ssd1306_mock_softc *sc;
+
+	h = ssd1306_alloc(model, flags);
+	if (h == SSD1306_INVALID_HANDLE)
+		return (SSD1306_INVALID_HANDLE);
+
+	sc = calloc(1, sizeof *sc);
+	if (sc == NULL) {
+		ssd1306_free(h);
+		return (SSD1306_INVALID_HANDLE);
+	}
+
+	h->ops = &ssd1306_mock_transport;
+	snprintf(h->device, sizeof(h->device), "mock");
+	h->softc = sc;
+	ssd1306_mock_reset(h);
+
+	return (h);
+}
+
+/*
+ * Emulated display RAM, MOCK_PAGES pages of MOCK_COLUMNS bytes each
+ */
+const uint8_t *
+ssd1306_mock_gddram(ssd1306_handle_t h)
+{
+	struct ssd1306_mock_softc *sc;
+
+	if (h->ops != &ssd1306_mock_transport)
+		return (NULL);
+	sc = h->softc;
+
+	return (sc->ram);
+}
+
+/*
+ * Pixel as the panel shows it, taking display start line, inverse
+ * mode and display on/off state into account
+ */
+int
+ssd1306_mock_pixel(ssd1306_handle_t h, int x, int y)
+{
+	struct ssd1306_mock_softc *sc;
+	int row, v;
+
+	if (h->ops != &ssd1306_mock_transport)
+		return (-1);
+	if ((x < 0) || (y < 0) || (x >= h->width) || (y >= h->height))
+		return (-1);
+
+	sc = h->softc;
+	if (!sc->display_on)
+		return (0);
+	row = (y + sc->startline) % (MOCK_PAGES * 8);
+	v = (sc->ram[(row / 8) * MOCK_COLUMNS + x] >> (row % 8)) & 1;
+
+	return (v ^ sc->inverse);
+}
@@ -0,0 +1,480 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ssd1306.h"
+#include "ssd1306_var.h"
+
+/*
+ * Frame buffer shared between display daemon and its clients. Daemon
+ * keeps the frame buffer of its handle in POSIX shared memory, clients
+ * map it and draw into it directly, then ask the daemon over a Unix
+ * socket to send changed parts to the panel. Changes are passed in
+ * per-page dirty ranges stored next to the frame buffer.
+ */
+
+#define	SHM_MAGIC	0x53534431
+#define	SHM_VERSION	1
+#define	SHM_NAME_MAX	64
+
+struct ssd1306_shm_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	int32_t		model;
+	int32_t		flags;
+	int32_t		fb_size;
+	/* Bumped by clients on every flush request */
+	uint32_t	seq;
+	/* Last sequence number sent to the panel */
+	uint32_t	flushed;
+	/* Process-shared, protects seq and dirty ranges */
+	pthread_mutex_t	lock;
+	struct ssd1306_dirty dirty[SSD1306_RAM_HEIGHT / 8];
+};
+
+#define	SHM_FB_OFFSET	((sizeof(struct ssd1306_shm_hdr) + 15) & ~15)
+
+/* Socket messages */
+#define	SHM_MSG_HELLO		1	/* daemon: shared memory object name */
+#define	SHM_MSG_FLUSH		2	/* client: send dirty ranges */
+#define	SHM_MSG_COMMANDS	3	/* client: send command bytes */
+
+struct ssd1306_shm_msg {
+	uint32_t	type;
+	uint32_t	len;
+	uint8_t		data[CMDBUF_SIZE];
+};
+
+struct ssd1306_shm_reply {
+	int32_t		status;
+	uint32_t	seq;
+};
+
+/* Daemon side */
+struct ssd1306_shm {
+	char		name[SHM_NAME_MAX];
+	struct ssd1306_shm_hdr *hdr;
+	size_t		size;
+	/* Frame buffer allocated by ssd1306_alloc, restored on destroy */
+	uint8_t		*orig_fb;
+};
+
+/* Client side */
+struct ssd1306_client_softc {
+	int		fd;
+	struct ssd1306_shm_hdr *hdr;
+	size_t		size;
+	uint8_t		*orig_fb;
+};
+
+static int
+ssd1306_shm_io(int fd, void *buf, size_t len, int out)
+{
+	uint8_t *p;
+	ssize_t n;
+
+	p = buf;
+	while (len > 0) {
+		if (out)
+			n = send(fd, p, len, MSG_NOSIGNAL);
+		else
+			n = recv(fd, p, len, 0);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n <= 0)
+			return (-1);
+		p += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+/*
+ * Merge dirty ranges. Ranges in shared memory hold whatever a client
+ * wrote there, so the one merged is clamped to the frame width first.
+ */
+static void
+ssd1306_shm_merge(ssd1306_handle_t h, struct ssd1306_dirty *to,
+    const struct ssd1306_dirty *from)
+{
+	int lo, hi;
+
+	lo = from->lo;
+	hi = from->hi;
+	if (lo < 0)
+		lo = 0;
+	if (hi > h->width - 1)
+		hi = h->width - 1;
+	if (lo > hi)
+		return;
+
+	if (lo < to->lo)
+		to->lo = lo;
+	if (hi > to->hi)
+		to->hi = hi;
+}
+
+/*
+ * Move frame buffer of h into shared memory object name, accessible
+ * with mode by group gid, or creator's group if gid is (gid_t)-1
+ */
+int
+ssd1306_shm_create(ssd1306_handle_t h, const char *name, mode_t mode,
+    gid_t gid)
+{
+	struct ssd1306_shm *s;
+	struct ssd1306_shm_hdr *hdr;
+	pthread_mutexattr_t attr;
+	void *base;
+	int fd, page;
+
+	if ((h->desc == NULL) || (h->async != NULL) || (h->shm != NULL))
+		return (-1);
+	if (strlen(name) >= SHM_NAME_MAX)
+		return (-1);
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return (-1);
+	memcpy(s->name, name, strlen(name));
+	s->size = SHM_FB_OFFSET + h->fb_size;
+
+	/* Object left from previous run may be mapped by anybody */
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+	if (fd < 0) {
+		free(s);
+		return (-1);
+	}
+	/* Clients draw into it, don't let umask get in the way */
+	if ((fchmod(fd, mode) < 0) ||
+	    ((gid != (gid_t)-1) && (fchown(fd, (uid_t)-1, gid) < 0)) ||
+	    (ftruncate(fd, s->size) < 0)) {
+		close(fd);
+		shm_unlink(name);
+		free(s);
+		return (-1);
+	}
+	base = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		shm_unlink(name);
+		free(s);
+		return (-1);
+	}
+
+	hdr = base;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->version = SHM_VERSION;
+	hdr->model = h->model;
+	hdr->flags = h->flags;
+	hdr->fb_size = h->fb_size;
+	for (page = 0; page < SSD1306_RAM_HEIGHT / 8; page++) {
+		hdr->dirty[page].lo = h->width;
+		hdr->dirty[page].hi = -1;
+	}
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (pthread_mutex_init(&hdr->lock, &attr)) {
+		pthread_mutexattr_destroy(&attr);
+		munmap(base, s->size);
+		shm_unlink(name);
+		free(s);
+		return (-1);
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	memcpy((uint8_t *)base + SHM_FB_OFFSET, h->fb, h->fb_size);
+	s->hdr = hdr;
+	s->orig_fb = h->fb;
+	h->fb = (uint8_t *)base + SHM_FB_OFFSET;
+	h->shm = s;
+	/* Header is complete, clients may use it */
+	hdr->magic = SHM_MAGIC;
+
+	return (0);
+}
+
+void
+ssd1306_shm_destroy(ssd1306_handle_t h)
+{
+	struct ssd1306_shm *s;
+
+	s = h->shm;
+	memcpy(s->orig_fb, h->fb, h->fb_size);
+	h->fb = s->orig_fb;
+	h->shm = NULL;
+
+	s->hdr->magic = 0;
+	pthread_mutex_destroy(&s->hdr->lock);
+	munmap(s->hdr, s->size);
+	shm_unlink(s->name);
+	free(s);
+}
+
+/*
+ * Greet newly connected client with the shared memory object name.
+ * Connection is switched to non-blocking mode, a client that sends
+ * partial request or doesn't read replies is dropped rather than
+ * stalling the daemon.
+ */
+int
+ssd1306_shm_accept(ssd1306_handle_t h, int fd)
+{
+	struct ssd1306_shm_msg msg;
+	int flags;
+
+	if (h->shm == NULL)
+		return (-1);
+	flags = fcntl(fd, F_GETFL);
+	if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+		return (-1);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = SHM_MSG_HELLO;
+	msg.len = strlen(h->shm->name) + 1;
+	memcpy(msg.data, h->shm->name, msg.len);
+
+	return (ssd1306_shm_io(fd, &msg, sizeof(msg), 1));
+}
+
+/*
+ * Handle one request from client connected to fd. Returns -1 if the
+ * connection should be closed.
+ */
+int
+ssd1306_shm_serve(ssd1306_handle_t h, int fd)
+{
+	struct ssd1306_shm_hdr *hdr;
+	struct ssd1306_shm_msg msg;
+	struct ssd1306_shm_reply reply;
+	uint32_t seq;
+	int page;
+
+	if (h->shm == NULL)
+		return (-1);
+	if (ssd1306_shm_io(fd, &msg, sizeof(msg), 0))
+		return (-1);
+
+	hdr = h->shm->hdr;
+	switch (msg.type) {
+	case SHM_MSG_FLUSH:
+		pthread_mutex_lock(&hdr->lock);
+		for (page = 0; page < h->pages; page++) {
+			ssd1306_shm_merge(h, &h->dirty[page],
+			    &hdr->dirty[page]);
+			hdr->dirty[page].lo = h->width;
+			hdr->dirty[page].hi = -1;
+		}
+		seq = hdr->seq;
+		pthread_mutex_unlock(&hdr->lock);
+		reply.status = ssd1306_refresh(h);
+		if (reply.status == 0)
+			hdr->flushed = seq;
+		reply.seq = hdr->flushed;
+		break;
+	case SHM_MSG_COMMANDS:
+		if (msg.len > sizeof(msg.data))
+			return (-1);
+		/* Client commands may change anything the cache holds */
+		SSD1306_IO_LOCK(h);
+		reply.status = ssd1306_commands(h, msg.data, msg.len);
+		ssd1306_regs_invalidate(h);
+		SSD1306_IO_UNLOCK(h);
+		reply.seq = hdr->flushed;
+		break;
+	default:
+		return (-1);
+	}
+
+	return (ssd1306_shm_io(fd, &reply, sizeof(reply), 1));
+}
+
+static int
+ssd1306_client_request(ssd1306_handle_t h, uint32_t type, const uint8_t *data,
+    int len)
+{
+	struct ssd1306_client_softc *sc;
+	struct ssd1306_shm_msg msg;
+	struct ssd1306_shm_reply reply;
+
+	sc = h->softc;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = type;
+	msg.len = len;
+	if (len > 0)
+		memcpy(msg.data, data, len);
+	if (ssd1306_shm_io(sc->fd, &msg, sizeof(msg), 1))
+		return (-1);
+	if (ssd1306_shm_io(sc->fd, &reply, sizeof(reply), 0))
+		return (-1);
+
+	return (reply.status ? -1 : 0);
+}
+
+static int
+ssd1306_client_write(ssd1306_handle_t h, int dc, uint8_t *data, int len)
+{
+
+	/* Frame data is only sent by the daemon */
+	if (dc)
+		return (-1);
+
+	return (ssd1306_client_request(h, SHM_MSG_COMMANDS, data, len));
+}
+
+static int
+ssd1306_client_refresh(ssd1306_handle_t h)
+{
+	struct ssd1306_client_softc *sc;
+	int page;
+
+	sc = h->softc;
+	pthread_mutex_lock(&sc->hdr->lock);
+	for (page = 0; page < h->pages; page++)
+		ssd1306_shm_merge(h, &sc->hdr->dirty[page], &h->dirty[page]);
+	sc->hdr->seq++;
+	pthread_mutex_unlock(&sc->hdr->lock);
+	ssd1306_dirty_clean(h, h->dirty);
+
+	return (ssd1306_client_request(h, SHM_MSG_FLUSH, NULL, 0));
+}
+
+static void
+ssd1306_client_close(ssd1306_handle_t h)
+{
+	struct ssd1306_client_softc *sc;
+
+	sc = h->softc;
+	h->fb = sc->orig_fb;
+	munmap(sc->hdr, sc->size);
+	close(sc->fd);
+	free(sc);
+}
+
+static const struct ssd1306_transport ssd1306_client_transport = {
+	.name = "ssd1306d",
+	.write = ssd1306_client_write,
+	.refresh = ssd1306_client_refresh,
+	.close = ssd1306_client_close,
+	/* Other clients send commands to the same controller */
+	.shared = 1,
+};
+
+/*
+ * Connect to display daemon listening on Unix socket path. Drawing on
+ * the returned handle goes straight to the daemon's frame buffer, the
+ * panel is already initialized.
+ */
+ssd1306_handle_t
+ssd1306_attach(const char *path)
+{
+	ssd1306_handle_t h;
+	struct ssd1306_client_softc *sc;
+	struct ssd1306_shm_hdr *hdr;
+	struct ssd1306_shm_msg msg;
+	struct sockaddr_un sun;
+	struct stat st;
+	void *base;
+	int fd, shm_fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		return (SSD1306_INVALID_HANDLE);
+	memcpy(sun.sun_path, path, strlen(path));
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return (SSD1306_INVALID_HANDLE);
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+		goto fail;
+	if (ssd1306_shm_io(fd, &msg, sizeof(msg), 0) ||
+	    (msg.type != SHM_MSG_HELLO) || (msg.len == 0) ||
+	    (msg.len > sizeof(msg.data)))
+		goto fail;
+	msg.data[msg.len - 1] = '\0';
+
+	shm_fd = shm_open((char *)msg.data, O_RDWR, 0);
+	if (shm_fd < 0)
+		goto fail;
+	if ((fstat(shm_fd, &st) < 0) ||
+	    (st.st_size < (off_t)sizeof(struct ssd1306_shm_hdr))) {
+		close(shm_fd);
+		goto fail;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    shm_fd, 0);
+	close(shm_fd);
+	if (base == MAP_FAILED)
+		goto fail;
+
+	hdr = base;
+	if ((hdr->magic != SHM_MAGIC) || (hdr->version != SHM_VERSION))
+		goto fail_unmap;
+	h = ssd1306_alloc(hdr->model, hdr->flags);
+	if (h == SSD1306_INVALID_HANDLE)
+		goto fail_unmap;
+	if ((hdr->fb_size != h->fb_size) ||
+	    (st.st_size < (off_t)(SHM_FB_OFFSET + h->fb_size))) {
+		ssd1306_free(h);
+		goto fail_unmap;
+	}
+
+	sc = malloc(sizeof(*sc));
+	if (sc == NULL) {
+		ssd1306_free(h);
+		goto fail_unmap;
+	}
+	sc->fd = fd;
+	sc->hdr = hdr;
+	sc->size = st.st_size;
+	sc->orig_fb = h->fb;
+	h->fb = (uint8_t *)base + SHM_FB_OFFSET;
+	h->ops = &ssd1306_client_transport;
+	h->softc = sc;
+	/* Whatever is on the panel stays there until redrawn */
+	ssd1306_dirty_clean(h, h->dirty);
+
+	return (h);
+
+fail_unmap:
+	munmap(base, st.st_size);
+fail:
+	close(fd);
+	return (SSD1306_INVALID_HANDLE);
+}
@@ -0,0 +1,214 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __SSD1306_VAR_H__
+#define __SSD1306_VAR_H__
+
+/* <sys/cdefs.h> provides it on FreeBSD only */
+#ifndef __unused
+#define	__unused	__attribute__((__unused__))
+#endif
+
+#define	SSD1306_SETCONTRAST	0x81
+#define	SSD1306_DISPLAYALLON_RESUME	0xA4
+#define	SSD1306_DISPLAYALLON	0xA5
+#define	SSD1306_NORMALDISPLAY	0xA6
+#define	SSD1306_INVERTDISPLAY	0xA7
+#define	SSD1306_DISPLAYOFF	0xAE
+#define	SSD1306_DISPLAYON	0xAF
+#define	SSD1306_SETDISPLAYOFFSET	0xD3
+#define	SSD1306_SETCOMPINS	0xDA
+#define	SSD1306_SETVCOMDETECT	0xDB
+#define	SSD1306_SETDISPLAYCLOCKDIV	0xD5
+#define	SSD1306_SETPRECHARGE	0xD9
+#define	SSD1306_SETMULTIPLEX	0xA8
+#define	SSD1306_SETLOWCOLUMN	0x00
+#define	SSD1306_SETHIGHCOLUMN	0x10
+#define	SSD1306_SETSTARTLINE	0x40
+#define	SSD1306_MEMORYMODE	0x20
+#define	SSD1306_COLUMNADDR	0x21
+#define	SSD1306_PAGEADDR	0x22
+#define	SSD1306_COMSCANINC	0xC0
+#define	SSD1306_COMSCANDEC	0xC8
+#define	SSD1306_SEGREMAP	0xA0
+#define	SSD1306_CHARGEPUMP	0x8D
+
+#define	SSD1306_RIGHT_HORIZONTAL_SCROLL	0x26
+#define	SSD1306_LEFT_HORIZONTAL_SCROLL	0x27
+#define	SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL	0x29
+#define	SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL	0x2A
+#define	SSD1306_DEACTIVATE_SCROLL	0x2E
+#define	SSD1306_ACTIVATE_SCROLL	0x2F
+#define	SSD1306_SET_VERTICAL_SCROLL_AREA	0xA3
+#define	SSD1306_SETPAGESTART	0xB0
+
+#define FONT_WIDTH	8
+
+/*
+ * Extra cost, in data bytes, of sending one more address window
+ * instead of extending current one over clean columns
+ */
+#define	WINDOW_COST	8
+
+/* Longest command sequence sent in one transfer */
+#define	CMDBUF_SIZE	64
+
+/*
+ * Last known state of DC line and controller registers, -1 if unknown.
+ * Address window is only known to be set if the last data transfer
+ * filled it completely, so the write pointer wrapped to its start.
+ */
+struct ssd1306_regs {
+	int		dc;
+	int		display_on;
+	int		contrast;
+	int		inverse;
+	int		startline;
+	int		col0;
+	int		col1;
+	int		page0;
+	int		page1;
+};
+
+/* Range of modified columns in one page, empty if lo > hi */
+struct ssd1306_dirty {
+	int		lo;
+	int		hi;
+};
+
+/* Record of the last controller initialization, see ssd1306_initialize_warm */
+#define	SSD1306_STATE_MAGIC	0x53534453
+#define	SSD1306_STATE_VERSION	2
+#define	SSD1306_DEVICE_MAX	64
+
+struct ssd1306_state {
+	uint32_t	magic;
+	uint32_t	version;
+	int32_t		model;
+	int32_t		flags;
+	int32_t		vccstate;
+	uint32_t	init_hash;
+	/* Bus and address panel is attached at */
+	char		device[SSD1306_DEVICE_MAX];
+};
+
+/* Per-model geometry and controller settings */
+struct ssd1306_model_desc {
+	int		width;
+	int		height;
+	uint8_t		multiplex;
+	uint8_t		compins;
+	/* Indexed by ssd1306_vccstate */
+	uint8_t		contrast[2];
+};
+
+/*
+ * Transport backend. write() may overwrite the data it sends. reset()
+ * and set_dc() can be NULL if there is no reset line or if commands and
+ * data are distinguished in-band.
+ */
+struct ssd1306_transport {
+	const char	*name;
+	int		(*reset)(ssd1306_handle_t h);
+	int		(*set_dc)(ssd1306_handle_t h, int dc);
+	int		(*write)(ssd1306_handle_t h, int dc, uint8_t *data, int len);
+	/* Optional, for transports that send frames on their own */
+	int		(*refresh)(ssd1306_handle_t h);
+	void		(*close)(ssd1306_handle_t h);
+	/* Controller is driven by other handles too, don't cache its state */
+	int		shared;
+};
+
+struct ssd1306_handle {
+	ssd1306_model	model;
+	const struct ssd1306_model_desc *desc;
+	int		flags;
+	/* Transport methods and private data */
+	const struct ssd1306_transport *ops;
+	void		*softc;
+	int		width;
+	int		height;
+	/* Frame buffer, 1 bit per pixel in SSD1306 page order */
+	uint8_t		*fb;
+	int		fb_size;
+	/* View port data in SSD1306-compatible format */
+	uint8_t		*scratch;
+	int		scratch_size;
+	/* Copy of frame buffer as it was last sent to the controller */
+	uint8_t		*shadow;
+	int		shadow_valid;
+	/* Per-page ranges of columns changed since last refresh */
+	struct ssd1306_dirty *dirty;
+	int		pages;
+	/* Shadow copy of the controller state */
+	struct ssd1306_regs regs;
+	/* Display RAM line the frame buffer is stored at */
+	int		ram_offset;
+	/* Background flusher state, NULL in synchronous mode */
+	struct ssd1306_async *async;
+	/* Frame buffer exported to clients, NULL if not shared */
+	struct ssd1306_shm *shm;
+	struct ssd1306_stats stats;
+	ssd1306_font	font;
+	/* Proportional font, overrides the fixed one if set */
+	struct ssd1306_pfont *pfont;
+	ssd1306_vccstate vccstate;
+	/* Where the panel is attached, identifies it in state records */
+	char		device[SSD1306_DEVICE_MAX];
+};
+
+ssd1306_handle_t ssd1306_alloc(ssd1306_model model, int flags);
+void ssd1306_regs_invalidate(ssd1306_handle_t h);
+void ssd1306_free(ssd1306_handle_t h);
+void ssd1306_dirty_mark(ssd1306_handle_t h, int page, int lo, int hi);
+void ssd1306_dirty_fill(ssd1306_handle_t h, struct ssd1306_dirty *dirty);
+void ssd1306_dirty_clean(ssd1306_handle_t h, struct ssd1306_dirty *dirty);
+int ssd1306_send(ssd1306_handle_t h, const uint8_t *fb,
+    struct ssd1306_dirty *dirty);
+void ssd1306_shm_destroy(ssd1306_handle_t h);
+int ssd1306_pfont_width(ssd1306_pfont_t f);
+int ssd1306_pfont_height(ssd1306_pfont_t f);
+int ssd1306_pfont_putchar(ssd1306_handle_t h, int x, int y, unsigned char c);
+void ssd1306_pfont_putstr(ssd1306_handle_t h, int x, int y, const char *s);
+void ssd1306_blit_band(ssd1306_handle_t h, int x, int y, const uint8_t *cols,
+    uint8_t mask, int n);
+
+/*
+ * Transport access is serialized only while flusher thread is running
+ */
+void ssd1306_async_lock(ssd1306_handle_t h);
+void ssd1306_async_unlock(ssd1306_handle_t h);
+
+#define	SSD1306_IO_LOCK(h)	do {				\
+	if ((h)->async != NULL)					\
+		ssd1306_async_lock(h);				\
+} while (0)
+
+#define	SSD1306_IO_UNLOCK(h)	do {				\
+	if ((h)->async != NULL)					\
+		ssd1306_async_unlock(h);			\
+} while (0)
+
+#endif /* __SSD1306_VAR_H__ */
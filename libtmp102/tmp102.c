@@ -24,56 +24,32 @@
  */
 
 #include <err.h>
-#include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
+#include <string.h>
+#include <time.h>
 
-#include <dev/iicbus/iic.h>
 #include "tmp102.h"
+#include "tmp102_var.h"
 
-static int
-reg_to_temp(uint16_t val, int extended)
-{
-	int sign, temp;
-	int bits;
-
-	if (extended) {
-		bits = 13;
-		val >>= 3;
-	}
-	else
-		val >>= 4;
-
-	if (val & (1 << (bits - 1))) {
-		sign = -1;
-		val = (1 << bits) - val;
-	}
-	else
-		sign = 1;
-
-	temp = val * 1000 / 16;
-
-	return (temp*sign);
-}
-
+/*
+ * Handle for sensor at addr on already open bus
+ */
 tmp102_handle_t
-tmp102_open(const char *i2cdev, int addr)
+tmp102_alloc(const struct tmp102_transport *ops, int fd, int addr)
 {
 	tmp102_handle_t h;
-	int fd;
 
-	fd = open(i2cdev, O_RDWR);
-	if (fd < 0)
-		return (TMP102_INVALID_HANDLE);
-
-	h = (tmp102_handle_t)malloc(sizeof(*h));
+	h = (tmp102_handle_t)calloc(1, sizeof(*h));
 	if (h == NULL)
 		return (TMP102_INVALID_HANDLE);
 
 	h->addr = (addr << 1);
 	h->fd = fd;
+	h->ops = ops;
+	tmp102_invalidate(h);
 
 	return (h);
 }
@@ -81,109 +57,471 @@ tmp102_open(const char *i2cdev, int addr)
 void
 tmp102_close(tmp102_handle_t h)
 {
-	close(h->fd);
+	tmp102_sampler_stop(h);
+	tmp102_alert_close(h);
+	h->ops->close(h);
 	free(h);
 }
 
+/*
+ * All bus traffic goes through here
+ */
+int
+tmp102_transfer(tmp102_handle_t h, struct tmp102_stats *stats,
+    struct iic_msg *msgs, int nmsgs)
+{
+	int i;
+
+	stats->transfers++;
+	for (i = 0; i < nmsgs; i++)
+		stats->bytes += msgs[i].len;
+	if (h->ops->transfer(h, msgs, nmsgs)) {
+		stats->errors++;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Account n register reads done by a transaction started at start
+ */
+void
+tmp102_stats_reads(struct tmp102_stats *stats, const struct timespec *start,
+    int n)
+{
+	struct timespec end;
+	uint64_t usec;
+	int bucket;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (end.tv_sec - start->tv_sec) * 1000000ULL +
+	    (end.tv_nsec - start->tv_nsec) / 1000;
+	for (bucket = 0; bucket < TMP102_HIST_BUCKETS - 1; bucket++)
+		if (usec < (2ULL << bucket))
+			break;
+	stats->reads += n;
+	stats->read_usec += usec;
+	stats->read_hist[bucket]++;
+}
+
+/*
+ * Append messages reading n registers to msgs, returns number of
+ * messages. Pointer register is only written when it doesn't already
+ * point to the register, so repeated reads of the same register are
+ * one read-only message.
+ */
+int
+tmp102_read_msgs(tmp102_handle_t h, const uint8_t *regs, int n,
+    struct iic_msg *msgs, uint8_t (*bytes)[2])
+{
+	int i, nmsgs, pointer;
+
+	nmsgs = 0;
+	pointer = h->pointer;
+	for (i = 0; i < n; i++) {
+		if (regs[i] != pointer) {
+			msgs[nmsgs].slave = h->addr;
+			msgs[nmsgs].flags = IIC_M_WR;
+			msgs[nmsgs].len = 1;
+			msgs[nmsgs].buf = (uint8_t *)&regs[i];
+			nmsgs++;
+			pointer = regs[i];
+		}
+		msgs[nmsgs].slave = h->addr;
+		msgs[nmsgs].flags = IIC_M_RD;
+		msgs[nmsgs].len = 2;
+		msgs[nmsgs].buf = bytes[i];
+		nmsgs++;
+	}
+
+	return (nmsgs);
+}
+
+/*
+ * Update cached pointer after transaction built by tmp102_read_msgs
+ * and decode register values
+ */
+void
+tmp102_read_done(tmp102_handle_t h, const uint8_t *regs, int n,
+    uint8_t (*bytes)[2], uint16_t *vals, int error)
+{
+	int i;
+
+	/* Failed transaction could have stopped anywhere */
+	if (error) {
+		h->pointer = -1;
+		return;
+	}
+
+	h->pointer = regs[n - 1];
+	for (i = 0; i < n; i++)
+		vals[i] = (bytes[i][0] << 8) | bytes[i][1];
+}
+
+/*
+ * Read registers in a single transaction
+ */
+int
+tmp102_read_registers(tmp102_handle_t h, const uint8_t *regs,
+    uint16_t *vals, int n)
+{
+	uint8_t bytes[TMP102_MAX_BATCH][2];
+	struct iic_msg msgs[2 * TMP102_MAX_BATCH];
+	struct timespec start;
+	int error, nmsgs;
+
+	nmsgs = tmp102_read_msgs(h, regs, n, msgs, bytes);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	error = tmp102_transfer(h, &h->stats, msgs, nmsgs);
+	tmp102_stats_reads(&h->stats, &start, n);
+	tmp102_read_done(h, regs, n, bytes, vals, error);
+
+	return (error ? -1 : 0);
+}
+
 int
 tmp102_read_register(tmp102_handle_t h, uint8_t reg, uint16_t *val)
 {
-	uint8_t bytes[2];
-	int error;
-	struct iic_rdwr_data data;
-	struct iic_msg msgs[2] = {
-		{0, IIC_M_WR, 1, &reg},
-		{0, IIC_M_RD, 2, bytes},
-	};
+	int err;
 
 	if (h == TMP102_INVALID_HANDLE)
 		return (-1);
 	if (val == NULL)
 		return (-1);
 
-	msgs[0].slave = h->addr;
-	msgs[1].slave = h->addr;
+	TMP102_LOCK(h);
+	err = tmp102_read_registers(h, &reg, val, 1);
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
 
-	data.nmsgs = 2;
-	data.msgs = msgs;
-	error = ioctl(h->fd, I2CRDWR, &data);
-	if (error)
+int
+tmp102_write_register(tmp102_handle_t h, uint8_t reg, uint16_t val)
+{
+	uint8_t bytes[3];
+	struct iic_msg msg = {0, IIC_M_WR, 3, bytes};
+	int err;
+
+	if (h == TMP102_INVALID_HANDLE)
 		return (-1);
 
-	*val = ((bytes[0] << 8) | bytes[1]);
+	/* Pointer and data go in one write, as the datasheet describes */
+	bytes[0] = reg;
+	bytes[1] = (val >> 8) & 0xff;
+	bytes[2] = val & 0xff;
+	msg.slave = h->addr;
+
+	TMP102_LOCK(h);
+	if (reg == TMP102_REG_CONF)
+		h->conf = -1;
+	err = tmp102_transfer(h, &h->stats, &msg, 1);
+	h->pointer = err ? -1 : reg;
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
+
+/*
+ * Forget cached sensor state, for when something else on the bus
+ * could have changed it
+ */
+void
+tmp102_invalidate(tmp102_handle_t h)
+{
+
+	TMP102_LOCK(h);
+	h->conf = -1;
+	h->pointer = -1;
+	TMP102_UNLOCK(h);
+}
+
+/*
+ * Cache config register value, without bits that change on their own
+ */
+void
+tmp102_conf_update(tmp102_handle_t h, uint16_t conf)
+{
+
+	h->conf = conf & ~(TMP102_CONF_OS | TMP102_CONF_AL);
+}
+
+/*
+ * Read registers holding temperatures and convert them, configuration
+ * register is fetched in the same transaction if EM bit is not known
+ */
+static int
+tmp102_read_temps(tmp102_handle_t h, const uint8_t *regs, int *temps, int n)
+{
+	uint8_t batch[TMP102_MAX_BATCH];
+	uint16_t vals[TMP102_MAX_BATCH];
+	int i, first;
+
+	first = 0;
+	if (h->conf < 0)
+		batch[first++] = TMP102_REG_CONF;
+	memcpy(batch + first, regs, n);
+	if (tmp102_read_registers(h, batch, vals, first + n))
+		return (-1);
+	if (first)
+		tmp102_conf_update(h, vals[0]);
+
+	for (i = 0; i < n; i++)
+		temps[i] = tmp102_reg_to_temp(vals[first + i],
+		    h->conf & TMP102_CONF_EM);
+
 	return (0);
 }
 
 int
-tmp102_write_register(tmp102_handle_t h, uint8_t reg, uint16_t val)
+tmp102_conf_get(tmp102_handle_t h)
 {
-	uint8_t bytes[2];
-	int error;
-	struct iic_rdwr_data data;
-	struct iic_msg msgs[2] = {
-		{0, IIC_M_WR, 1, &reg},
-		{0, IIC_M_WR, 2, bytes},
-	};
+	static const uint8_t reg = TMP102_REG_CONF;
+	uint16_t conf;
 
-	if (h == TMP102_INVALID_HANDLE)
+	if (h->conf < 0) {
+		if (tmp102_read_registers(h, &reg, &conf, 1))
+			return (-1);
+		tmp102_conf_update(h, conf);
+	}
+
+	return (h->conf);
+}
+
+static int
+tmp102_conf_set(tmp102_handle_t h, uint16_t conf)
+{
+	uint8_t bytes[3];
+	struct iic_msg msg = {0, IIC_M_WR, 3, bytes};
+
+	bytes[0] = TMP102_REG_CONF;
+	bytes[1] = (conf >> 8) & 0xff;
+	bytes[2] = conf & 0xff;
+	msg.slave = h->addr;
+
+	if (tmp102_transfer(h, &h->stats, &msg, 1)) {
+		h->conf = h->pointer = -1;
 		return (-1);
+	}
+	h->pointer = TMP102_REG_CONF;
+	tmp102_conf_update(h, conf);
 
-	bytes[0] = (val >> 8) & 0xff;
-	bytes[1] = val & 0xff;
+	return (0);
+}
+
+static void
+tmp102_sleep_until(const struct timespec *deadline)
+{
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+	    deadline, NULL) == EINTR)
+		;
+}
 
-	msgs[0].slave = h->addr;
-	msgs[1].slave = h->addr;
+static void
+timespec_add_ms(struct timespec *ts, int ms)
+{
 
-	data.nmsgs = 2;
-	data.msgs = msgs;
-	error = ioctl(h->fd, I2CRDWR, &data);
-	if (error)
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * Trigger single conversion and leave the sensor shut down. Result is
+ * first read after the typical conversion time, then every millisecond
+ * until OS bit says conversion is done or the maximum time is up. Config
+ * and temperature are fetched in one transaction.
+ */
+static int
+tmp102_oneshot_locked(tmp102_handle_t h, int *temp)
+{
+	static const uint8_t regs[] = { TMP102_REG_CONF, TMP102_REG_TEMP };
+	struct timespec now, deadline, timeout;
+	uint16_t vals[2];
+	int conf;
+
+	if ((conf = tmp102_conf_get(h)) < 0)
 		return (-1);
+	if (tmp102_conf_set(h, conf | TMP102_CONF_SD | TMP102_CONF_OS))
+		return (-1);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	deadline = timeout = now;
+	timespec_add_ms(&deadline, TMP102_CONV_TYP_MS);
+	timespec_add_ms(&timeout, TMP102_CONV_MAX_MS);
+	for (;;) {
+		tmp102_sleep_until(&deadline);
+		if (tmp102_read_registers(h, regs, vals, 2))
+			return (-1);
+		if (vals[0] & TMP102_CONF_OS)
+			break;
+		if ((deadline.tv_sec > timeout.tv_sec) ||
+		    ((deadline.tv_sec == timeout.tv_sec) &&
+		    (deadline.tv_nsec >= timeout.tv_nsec)))
+			return (-1);
+		timespec_add_ms(&deadline, 1);
+	}
 
+	*temp = tmp102_reg_to_temp(vals[1], h->conf & TMP102_CONF_EM);
 	return (0);
 }
 
 int
-tmp102_read_temp(tmp102_handle_t h, int *temp)
+tmp102_oneshot_read(tmp102_handle_t h, int *temp)
 {
-	uint16_t conf_reg, temp_reg;
-	int extended;
 	int err;
 
 	if (h == TMP102_INVALID_HANDLE)
 		return (-1);
 
-	if ((err = tmp102_read_register(h, TMP102_REG_CONF, &conf_reg)))
-		return (err);
-	extended = (conf_reg & TMP102_CONF_EM) ? 1 : 0;
-	if ((err = tmp102_read_register(h, TMP102_REG_TEMP, &temp_reg)))
-		return (err);
+	TMP102_LOCK(h);
+	err = tmp102_oneshot_locked(h, temp);
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
+
+/*
+ * In shutdown mode temperature register holds the result of the last
+ * conversion, however old, so a fresh one is requested
+ */
+int
+tmp102_read_temp_locked(tmp102_handle_t h, int *temp)
+{
+	static const uint8_t regs[] = { TMP102_REG_TEMP };
+	int conf;
+
+	/* Sensor may have been shut down before it was opened */
+	if ((conf = tmp102_conf_get(h)) < 0)
+		return (-1);
+	if (conf & TMP102_CONF_SD)
+		return (tmp102_oneshot_locked(h, temp));
+	return (tmp102_read_temps(h, regs, temp, 1));
+}
+
+int
+tmp102_get_config(tmp102_handle_t h, struct tmp102_config *cfg)
+{
+	int conf;
+
+	if (h == TMP102_INVALID_HANDLE)
+		return (-1);
+
+	TMP102_LOCK(h);
+	conf = tmp102_conf_get(h);
+	TMP102_UNLOCK(h);
+	if (conf < 0)
+		return (-1);
 
-	*temp = reg_to_temp(temp_reg, extended);
+	cfg->rate = (conf & TMP102_CONF_CR_MASK) >> TMP102_CONF_CR_SHIFT;
+	cfg->extended = (conf & TMP102_CONF_EM) ? 1 : 0;
+	cfg->shutdown = (conf & TMP102_CONF_SD) ? 1 : 0;
+	cfg->interrupt = (conf & TMP102_CONF_TM) ? 1 : 0;
+	cfg->polarity = (conf & TMP102_CONF_POL) ? 1 : 0;
+	cfg->faults = (conf & TMP102_CONF_F_MASK) >> TMP102_CONF_F_SHIFT;
 
 	return (0);
 }
 
 int
-tmp102_read_temp_bracket(tmp102_handle_t h, int *lower, int *higher)
+tmp102_set_config(tmp102_handle_t h, const struct tmp102_config *cfg)
 {
-	uint16_t conf_reg, low_reg, high_reg;
-	int extended;
+	uint16_t conf;
 	int err;
 
 	if (h == TMP102_INVALID_HANDLE)
 		return (-1);
+	if ((cfg->rate < TMP102_RATE_0_25HZ) || (cfg->rate > TMP102_RATE_8HZ))
+		return (-1);
+	if ((cfg->faults < TMP102_FAULTS_1) || (cfg->faults > TMP102_FAULTS_6))
+		return (-1);
 
-	if ((err = tmp102_read_register(h, TMP102_REG_CONF, &conf_reg)))
-		return (err);
-	extended = (conf_reg & TMP102_CONF_EM) ? 1 : 0;
-	if ((err = tmp102_read_register(h, TMP102_REG_TEMP_LOW, &low_reg)))
-		return (err);
-	if ((err = tmp102_read_register(h, TMP102_REG_TEMP_HIGH, &high_reg)))
-		return (err);
+	/* Resolution bits are read-only and always 1 */
+	conf = TMP102_CONF_R_MASK;
+	conf |= cfg->rate << TMP102_CONF_CR_SHIFT;
+	conf |= cfg->faults << TMP102_CONF_F_SHIFT;
+	if (cfg->extended)
+		conf |= TMP102_CONF_EM;
+	if (cfg->shutdown)
+		conf |= TMP102_CONF_SD;
+	if (cfg->interrupt)
+		conf |= TMP102_CONF_TM;
+	if (cfg->polarity)
+		conf |= TMP102_CONF_POL;
+
+	TMP102_LOCK(h);
+	err = tmp102_conf_set(h, conf);
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
 
-	*lower = reg_to_temp(low_reg, extended);
-	*higher = reg_to_temp(high_reg, extended);
+/*
+ * While sampler is running the latest sample is returned, the bus is
+ * only touched if there is none yet
+ */
+int
+tmp102_read_temp(tmp102_handle_t h, int *temp)
+{
+	struct tmp102_sample sample;
+	int err;
+
+	if (h == TMP102_INVALID_HANDLE)
+		return (-1);
+	if ((h->sampler != NULL) && (tmp102_sample_latest(h, &sample) == 0)) {
+		*temp = sample.temp;
+		return (0);
+	}
+
+	TMP102_LOCK(h);
+	err = tmp102_read_temp_locked(h, temp);
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
+
+int
+tmp102_read_temp_bracket(tmp102_handle_t h, int *lower, int *higher)
+{
+	static const uint8_t regs[] = {
+		TMP102_REG_TEMP_LOW, TMP102_REG_TEMP_HIGH
+	};
+	int temps[2];
+	int err;
+
+	if (h == TMP102_INVALID_HANDLE)
+		return (-1);
+
+	TMP102_LOCK(h);
+	err = tmp102_read_temps(h, regs, temps, 2);
+	TMP102_UNLOCK(h);
+	if (err)
+		return (-1);
+	*lower = temps[0];
+	*higher = temps[1];
 
 	return (0);
 }
+
+void
+tmp102_get_stats(tmp102_handle_t h, struct tmp102_stats *stats)
+{
+
+	TMP102_LOCK(h);
+	*stats = h->stats;
+	TMP102_UNLOCK(h);
+}
+
+void
+tmp102_reset_stats(tmp102_handle_t h)
+{
+
+	TMP102_LOCK(h);
+	memset(&h->stats, 0, sizeof(h->stats));
+	TMP102_UNLOCK(h);
+}
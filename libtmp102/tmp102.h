@@ -26,28 +26,160 @@
 #ifndef __TMP102_H__
 #define __TMP102_H__
 
+#include <stdint.h>
+#include <time.h>
+
 #define	TMP102_DEFAULT_ADDR	0x48
 #define	TMP102_INVALID_HANDLE	NULL
 
 #define	TMP102_REG_TEMP		0
 #define	TMP102_REG_CONF		1
-#define		TMP102_CONF_EM		(1 << 4)
+#define		TMP102_CONF_EM		(1 << 4)	/* extended mode */
+#define		TMP102_CONF_AL		(1 << 5)	/* alert, read-only */
+#define		TMP102_CONF_CR_SHIFT	6		/* conversion rate */
+#define		TMP102_CONF_CR_MASK	(3 << 6)
+#define		TMP102_CONF_SD		(1 << 8)	/* shutdown */
+#define		TMP102_CONF_TM		(1 << 9)	/* thermostat mode */
+#define		TMP102_CONF_POL		(1 << 10)	/* alert polarity */
+#define		TMP102_CONF_F_SHIFT	11		/* fault queue */
+#define		TMP102_CONF_F_MASK	(3 << 11)
+#define		TMP102_CONF_R_MASK	(3 << 13)	/* resolution, read-only */
+#define		TMP102_CONF_OS		(1 << 15)	/* one-shot */
 #define	TMP102_REG_TEMP_LOW	2
 #define	TMP102_REG_TEMP_HIGH	3
 
+/*
+ * Register read latency histogram: bucket n counts reads that took
+ * 2^n..2^(n+1)-1 microseconds, first and last buckets also count
+ * everything shorter and longer respectively
+ */
+#define	TMP102_HIST_BUCKETS	16
+
+struct tmp102_stats {
+	uint64_t	transfers;	/* I2CRDWR requests issued */
+	uint64_t	bytes;		/* bytes sent and received */
+	uint64_t	errors;		/* failed requests */
+	uint64_t	reads;		/* register reads */
+	uint64_t	read_usec;	/* total time spent in register reads */
+	uint64_t	read_hist[TMP102_HIST_BUCKETS];
+};
+
+/* Temperature sample taken by the sampler thread */
+struct tmp102_sample {
+	struct timespec	ts;		/* CLOCK_MONOTONIC */
+	int		temp;		/* millidegrees Celsius */
+};
+
+#define	TMP102_SAMPLER_MAX	65536
+
+/*
+ * Sensor state is cached on the assumption that the handle is the only
+ * one talking to the sensor, tmp102_invalidate() drops it otherwise
+ */
 struct tmp102_handle {
 	int fd;
 	uint8_t addr;
+	/* Bus backend methods and private data */
+	const struct tmp102_transport *ops;
+	void *softc;
+	int conf;		/* config register, -1 if unknown */
+	int pointer;		/* pointer register, -1 if unknown */
+	int alert;		/* ALERT line is being watched */
+	/* Background sampling state, NULL unless started */
+	struct tmp102_sampler *sampler;
+	struct tmp102_stats stats;
 };
 
 typedef struct tmp102_handle* tmp102_handle_t;
 
+typedef enum {
+	TMP102_RATE_0_25HZ,
+	TMP102_RATE_1HZ,
+	TMP102_RATE_4HZ,
+	TMP102_RATE_8HZ
+} tmp102_rate;
+
+/* Consecutive faults needed to change alert state */
+typedef enum {
+	TMP102_FAULTS_1,
+	TMP102_FAULTS_2,
+	TMP102_FAULTS_4,
+	TMP102_FAULTS_6
+} tmp102_faults;
+
+struct tmp102_config {
+	tmp102_rate	rate;		/* continuous conversion rate */
+	int		extended;	/* 13-bit, up to 150C */
+	int		shutdown;	/* convert only on one-shot request */
+	int		interrupt;	/* alert in interrupt, not comparator mode */
+	int		polarity;	/* alert is active high */
+	tmp102_faults	faults;
+};
+
+/* Conversion time from the datasheet */
+#define	TMP102_CONV_TYP_MS	26
+#define	TMP102_CONV_MAX_MS	35
+
+#define	TMP102_INVALID_GROUP	NULL
+/* ADD0 pin selects one of 4 addresses starting at the default one */
+#define	TMP102_GROUP_MAX	4
+
+typedef struct tmp102_group* tmp102_group_t;
+
 tmp102_handle_t tmp102_open(const char *i2cdev, int addr);
 void tmp102_close(tmp102_handle_t);
 int tmp102_read_temp(tmp102_handle_t h, int *temp);
 int tmp102_read_temp_bracket(tmp102_handle_t h, int *lower, int *higher);
+void tmp102_get_stats(tmp102_handle_t h, struct tmp102_stats *stats);
+void tmp102_reset_stats(tmp102_handle_t h);
+void tmp102_invalidate(tmp102_handle_t h);
+int tmp102_get_config(tmp102_handle_t h, struct tmp102_config *cfg);
+int tmp102_set_config(tmp102_handle_t h, const struct tmp102_config *cfg);
+int tmp102_oneshot_read(tmp102_handle_t h, int *temp);
+
+/*
+ * ALERT output event: temperature read right after the line changed.
+ * In comparator mode active tells if temperature went above the high
+ * limit and has not dropped below the low one since, in interrupt mode
+ * every event is a crossing of either limit.
+ */
+struct tmp102_alert {
+	struct timespec	ts;		/* CLOCK_MONOTONIC */
+	int		temp;
+	int		active;
+};
+
+/* Threshold monitoring through the ALERT line */
+int tmp102_set_limits(tmp102_handle_t h, int low, int high);
+int tmp102_get_limits(tmp102_handle_t h, int *low, int *high);
+int tmp102_alert_open(tmp102_handle_t h, int gpio_unit, int gpio_pin);
+int tmp102_alert_wait(tmp102_handle_t h, int timeout_ms,
+    struct tmp102_alert *alert);
+void tmp102_alert_close(tmp102_handle_t h);
+
+/* Simulated sensor and ALERT line */
+tmp102_handle_t tmp102_open_sim(int addr);
+void tmp102_sim_set_temp(tmp102_handle_t h, int temp);
+
+/* Background sampling */
+int tmp102_sampler_start(tmp102_handle_t h, int period_ms, int depth);
+void tmp102_sampler_stop(tmp102_handle_t h);
+int tmp102_sample_latest(tmp102_handle_t h, struct tmp102_sample *sample);
+int tmp102_sample_history(tmp102_handle_t h, struct tmp102_sample *samples,
+    int n);
+
+/* All sensors on one bus, read in a single transaction */
+tmp102_group_t tmp102_group_open(const char *i2cdev);
+void tmp102_group_close(tmp102_group_t g);
+int tmp102_group_count(tmp102_group_t g);
+int tmp102_group_addr(tmp102_group_t g, int i);
+tmp102_handle_t tmp102_group_sensor(tmp102_group_t g, int i);
+int tmp102_group_read_temp(tmp102_group_t g, int *temps);
+void tmp102_group_get_stats(tmp102_group_t g, struct tmp102_stats *stats);
 
 /* Low-level API */
+int tmp102_reg_to_temp(uint16_t val, int extended);
+uint16_t tmp102_temp_to_reg(int temp, int extended);
 int tmp102_read_register(tmp102_handle_t h, uint8_t reg, uint16_t *val);
 int tmp102_write_register(tmp102_handle_t h, uint8_t reg, uint16_t val);
 
@@ -0,0 +1,165 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "tmp102.h"
+#include "tmp102_var.h"
+
+/*
+ * Threshold monitoring: sensor compares every conversion against the
+ * low and high limit registers and drives its ALERT output, so the
+ * bus is only touched when the line changes.
+ */
+
+/*
+ * Program both limits in one transaction, in millidegrees Celsius
+ */
+int
+tmp102_set_limits(tmp102_handle_t h, int low, int high)
+{
+	uint8_t bytes[2][3];
+	struct iic_msg msgs[2];
+	uint16_t val;
+	int conf, err, i;
+
+	if (h == TMP102_INVALID_HANDLE)
+		return (-1);
+	if (low > high)
+		return (-1);
+
+	TMP102_LOCK(h);
+	if ((conf = tmp102_conf_get(h)) < 0) {
+		TMP102_UNLOCK(h);
+		return (-1);
+	}
+	for (i = 0; i < 2; i++) {
+		val = tmp102_temp_to_reg(i ? high : low, conf & TMP102_CONF_EM);
+		bytes[i][0] = i ? TMP102_REG_TEMP_HIGH : TMP102_REG_TEMP_LOW;
+		bytes[i][1] = (val >> 8) & 0xff;
+		bytes[i][2] = val & 0xff;
+		msgs[i].slave = h->addr;
+		msgs[i].flags = IIC_M_WR;
+		msgs[i].len = 3;
+		msgs[i].buf = bytes[i];
+	}
+	err = tmp102_transfer(h, &h->stats, msgs, 2);
+	h->pointer = err ? -1 : TMP102_REG_TEMP_HIGH;
+	TMP102_UNLOCK(h);
+
+	return (err);
+}
+
+int
+tmp102_get_limits(tmp102_handle_t h, int *low, int *high)
+{
+
+	return (tmp102_read_temp_bracket(h, low, high));
+}
+
+/*
+ * Watch ALERT line connected to gpio_pin, as configured at the time
+ * of the call: both edges in comparator mode, only the active one in
+ * interrupt mode since reading the sensor releases the line
+ */
+int
+tmp102_alert_open(tmp102_handle_t h, int gpio_unit, int gpio_pin)
+{
+	int conf, edges, err;
+
+	if ((h == TMP102_INVALID_HANDLE) || h->alert)
+		return (-1);
+
+	TMP102_LOCK(h);
+	conf = tmp102_conf_get(h);
+	TMP102_UNLOCK(h);
+	if (conf < 0)
+		return (-1);
+
+	if ((conf & TMP102_CONF_TM) == 0)
+		edges = TMP102_EDGE_FALLING | TMP102_EDGE_RISING;
+	else if (conf & TMP102_CONF_POL)
+		edges = TMP102_EDGE_RISING;
+	else
+		edges = TMP102_EDGE_FALLING;
+
+	err = h->ops->alert_open(h, gpio_unit, gpio_pin, edges);
+	if (err == 0)
+		h->alert = 1;
+
+	return (err);
+}
+
+/*
+ * Block until ALERT line changes or timeout_ms passes, negative
+ * timeout waits forever. Returns 1 and fills alert on event, 0 on
+ * timeout.
+ */
+int
+tmp102_alert_wait(tmp102_handle_t h, int timeout_ms,
+    struct tmp102_alert *alert)
+{
+	static const uint8_t regs[] = { TMP102_REG_CONF, TMP102_REG_TEMP };
+	uint16_t vals[2];
+	int err;
+
+	if ((h == TMP102_INVALID_HANDLE) || !h->alert)
+		return (-1);
+
+	err = h->ops->alert_wait(h, timeout_ms);
+	if (err <= 0)
+		return (err);
+	clock_gettime(CLOCK_MONOTONIC, &alert->ts);
+
+	/* Config has AL bit, it's fetched together with temperature */
+	TMP102_LOCK(h);
+	err = tmp102_read_registers(h, regs, vals, 2);
+	if (err == 0)
+		tmp102_conf_update(h, vals[0]);
+	TMP102_UNLOCK(h);
+	if (err)
+		return (-1);
+
+	alert->temp = tmp102_reg_to_temp(vals[1], vals[0] & TMP102_CONF_EM);
+	/* AL bit follows the line level, POL says which level is active */
+	if (vals[0] & TMP102_CONF_TM)
+		alert->active = 1;
+	else
+		alert->active = !(vals[0] & TMP102_CONF_AL) ==
+		    !(vals[0] & TMP102_CONF_POL);
+
+	return (1);
+}
+
+void
+tmp102_alert_close(tmp102_handle_t h)
+{
+
+	if (!h->alert)
+		return;
+	h->ops->alert_close(h);
+	h->alert = 0;
+}
@@ -0,0 +1,84 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include "tmp102.h"
+
+/*
+ * Register format conversions, kept apart from bus code so they build
+ * on any host
+ */
+
+/*
+ * Convert temperature register value to millidegrees Celsius
+ */
+int
+tmp102_reg_to_temp(uint16_t val, int extended)
+{
+	int sign, temp;
+	int bits;
+
+	if (extended) {
+		bits = 13;
+		val >>= 3;
+	}
+	else {
+		bits = 12;
+		val >>= 4;
+	}
+
+	if (val & (1 << (bits - 1))) {
+		sign = -1;
+		val = (1 << bits) - val;
+	}
+	else
+		sign = 1;
+
+	temp = val * 1000 / 16;
+
+	return (temp*sign);
+}
+
+/*
+ * Convert millidegrees Celsius to limit register value
+ */
+uint16_t
+tmp102_temp_to_reg(int temp, int extended)
+{
+	int bits, val, max;
+
+	bits = extended ? 13 : 12;
+	max = (1 << (bits - 1)) - 1;
+	/* Round to nearest 1/16 of a degree, away from zero */
+	val = (temp * 16 + (temp < 0 ? -500 : 500)) / 1000;
+	if (val > max)
+		val = max;
+	if (val < -max - 1)
+		val = -max - 1;
+	val &= (1 << bits) - 1;
+
+	return (extended ? val << 3 : val << 4);
+}
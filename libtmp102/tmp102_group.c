@@ -0,0 +1,201 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tmp102.h"
+#include "tmp102_var.h"
+
+/*
+ * Sensors sharing one bus, polled together: messages for all of them
+ * go into a single I2CRDWR request. Once pointer registers are set up
+ * that is one 2-byte read message per sensor.
+ */
+
+struct tmp102_group {
+	int		fd;
+	int		count;
+	tmp102_handle_t	sensors[TMP102_GROUP_MAX];
+	struct tmp102_stats stats;
+};
+
+/*
+ * Open bus and probe every address TMP102 can be strapped to. Sensor
+ * is present if its config register can be read.
+ */
+tmp102_group_t
+tmp102_group_open(const char *i2cdev)
+{
+	tmp102_group_t g;
+	tmp102_handle_t h;
+	uint16_t conf;
+	int addr;
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL)
+		return (TMP102_INVALID_GROUP);
+	g->fd = open(i2cdev, O_RDWR);
+	if (g->fd < 0) {
+		free(g);
+		return (TMP102_INVALID_GROUP);
+	}
+
+	for (addr = TMP102_DEFAULT_ADDR;
+	    addr < TMP102_DEFAULT_ADDR + TMP102_GROUP_MAX; addr++) {
+		h = tmp102_alloc(&tmp102_iic_transport, g->fd, addr);
+		if (h == TMP102_INVALID_HANDLE)
+			break;
+		if (tmp102_read_register(h, TMP102_REG_CONF, &conf)) {
+			free(h);
+			continue;
+		}
+		tmp102_conf_update(h, conf);
+		g->sensors[g->count++] = h;
+	}
+
+	if (g->count == 0) {
+		tmp102_group_close(g);
+		return (TMP102_INVALID_GROUP);
+	}
+
+	return (g);
+}
+
+void
+tmp102_group_close(tmp102_group_t g)
+{
+	int i;
+
+	/* Handles share group's descriptor, can't tmp102_close() them */
+	for (i = 0; i < g->count; i++) {
+		tmp102_sampler_stop(g->sensors[i]);
+		tmp102_alert_close(g->sensors[i]);
+		free(g->sensors[i]);
+	}
+	close(g->fd);
+	free(g);
+}
+
+int
+tmp102_group_count(tmp102_group_t g)
+{
+
+	return (g->count);
+}
+
+/*
+ * Handle for per-sensor access, owned by the group
+ */
+tmp102_handle_t
+tmp102_group_sensor(tmp102_group_t g, int i)
+{
+
+	if ((i < 0) || (i >= g->count))
+		return (TMP102_INVALID_HANDLE);
+	return (g->sensors[i]);
+}
+
+int
+tmp102_group_addr(tmp102_group_t g, int i)
+{
+
+	if ((i < 0) || (i >= g->count))
+		return (-1);
+	return (g->sensors[i]->addr >> 1);
+}
+
+/*
+ * Read temperatures of all sensors into temps, in the same order as
+ * tmp102_group_sensor() indexes them. A sensor that stops responding
+ * fails the whole transaction. Sensors in shutdown mode report their
+ * last conversion.
+ */
+int
+tmp102_group_read_temp(tmp102_group_t g, int *temps)
+{
+	uint8_t regs[TMP102_GROUP_MAX][2];
+	uint8_t bytes[TMP102_GROUP_MAX][2][2];
+	struct iic_msg msgs[TMP102_GROUP_MAX * 4];
+	int nregs[TMP102_GROUP_MAX];
+	struct timespec start;
+	tmp102_handle_t h;
+	uint16_t vals[2];
+	int error, i, n, nmsgs, nreads;
+
+	/*
+	 * Member handles are handed out by tmp102_group_sensor() and may
+	 * have a sampler of their own, keep it off their cached pointers
+	 * until the transaction is done. Locks are always taken in index
+	 * order.
+	 */
+	for (i = 0; i < g->count; i++)
+		TMP102_LOCK(g->sensors[i]);
+
+	nmsgs = nreads = 0;
+	for (i = 0; i < g->count; i++) {
+		h = g->sensors[i];
+		/* Config written since last read, fetch EM bit as well */
+		n = 0;
+		if (h->conf < 0)
+			regs[i][n++] = TMP102_REG_CONF;
+		regs[i][n++] = TMP102_REG_TEMP;
+		nregs[i] = n;
+		nreads += n;
+		nmsgs += tmp102_read_msgs(h, regs[i], n, msgs + nmsgs,
+		    bytes[i]);
+	}
+
+	/* Sensors share the bus, any of them can carry the request */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	error = tmp102_transfer(g->sensors[0], &g->stats, msgs, nmsgs);
+	tmp102_stats_reads(&g->stats, &start, nreads);
+
+	for (i = 0; i < g->count; i++) {
+		h = g->sensors[i];
+		tmp102_read_done(h, regs[i], nregs[i], bytes[i], vals, error);
+		if (error)
+			continue;
+		if (nregs[i] > 1)
+			tmp102_conf_update(h, vals[0]);
+		temps[i] = tmp102_reg_to_temp(vals[nregs[i] - 1],
+		    h->conf & TMP102_CONF_EM);
+	}
+
+	for (i = g->count - 1; i >= 0; i--)
+		TMP102_UNLOCK(g->sensors[i]);
+
+	return (error ? -1 : 0);
+}
+
+void
+tmp102_group_get_stats(tmp102_group_t g, struct tmp102_stats *stats)
+{
+
+	*stats = g->stats;
+}
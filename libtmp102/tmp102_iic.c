@@ -0,0 +1,188 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgpio.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <dev/iicbus/iic.h>
+#include "tmp102.h"
+#include "tmp102_var.h"
+
+/*
+ * iic(4) bus, ALERT line on a gpioc(4) pin configured to report
+ * interrupts as events readable from the controller device
+ */
+
+struct tmp102_iic_alert {
+	gpio_handle_t	gpio;
+	int		pin;
+};
+
+static int
+tmp102_iic_transfer(tmp102_handle_t h, struct iic_msg *msgs, int nmsgs)
+{
+	struct iic_rdwr_data data;
+
+	data.nmsgs = nmsgs;
+	data.msgs = msgs;
+
+	return (ioctl(h->fd, I2CRDWR, &data) < 0 ? -1 : 0);
+}
+
+static int
+tmp102_iic_alert_open(tmp102_handle_t h, int gpio_unit, int gpio_pin,
+    int edges)
+{
+	struct tmp102_iic_alert *sc;
+	gpio_config_t cfg;
+
+	sc = malloc(sizeof(*sc));
+	if (sc == NULL)
+		return (-1);
+	sc->gpio = gpio_open(gpio_unit);
+	if (sc->gpio == GPIO_INVALID_HANDLE) {
+		free(sc);
+		return (-1);
+	}
+	sc->pin = gpio_pin;
+
+	cfg.g_pin = gpio_pin;
+	cfg.g_flags = GPIO_PIN_INPUT;
+	if (edges == (TMP102_EDGE_FALLING | TMP102_EDGE_RISING))
+		cfg.g_flags |= GPIO_INTR_EDGE_BOTH;
+	else if (edges == TMP102_EDGE_RISING)
+		cfg.g_flags |= GPIO_INTR_EDGE_RISING;
+	else
+		cfg.g_flags |= GPIO_INTR_EDGE_FALLING;
+	if (gpio_pin_set_flags(sc->gpio, &cfg) < 0) {
+		gpio_close(sc->gpio);
+		free(sc);
+		return (-1);
+	}
+	h->softc = sc;
+
+	return (0);
+}
+
+/*
+ * Sleep in poll() until the pin reports an edge. Events that piled up
+ * are all consumed, the caller reads the sensor state anyway.
+ */
+static int
+tmp102_iic_alert_wait(tmp102_handle_t h, int timeout_ms)
+{
+	struct tmp102_iic_alert *sc;
+	struct gpio_event_detail ev[8];
+	struct pollfd pfd;
+	struct timespec start, now;
+	ssize_t n;
+	int i, left, found;
+
+	sc = h->softc;
+	pfd.fd = sc->gpio;
+	pfd.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	left = timeout_ms;
+	for (;;) {
+		switch (poll(&pfd, 1, left)) {
+		case -1:
+			if (errno != EINTR)
+				return (-1);
+			break;
+		case 0:
+			return (0);
+		default:
+			n = read(sc->gpio, ev, sizeof(ev));
+			if (n < 0)
+				return (-1);
+			found = 0;
+			for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++)
+				if (ev[i].gp_pin == sc->pin)
+					found = 1;
+			if (found)
+				return (1);
+			break;
+		}
+
+		if (timeout_ms < 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left = timeout_ms - ((now.tv_sec - start.tv_sec) * 1000 +
+		    (now.tv_nsec - start.tv_nsec) / 1000000);
+		if (left <= 0)
+			return (0);
+	}
+}
+
+static void
+tmp102_iic_alert_close(tmp102_handle_t h)
+{
+	struct tmp102_iic_alert *sc;
+
+	sc = h->softc;
+	gpio_close(sc->gpio);
+	free(sc);
+	h->softc = NULL;
+}
+
+static void
+tmp102_iic_close(tmp102_handle_t h)
+{
+
+	close(h->fd);
+}
+
+const struct tmp102_transport tmp102_iic_transport = {
+	.name = "iic",
+	.transfer = tmp102_iic_transfer,
+	.alert_open = tmp102_iic_alert_open,
+	.alert_wait = tmp102_iic_alert_wait,
+	.alert_close = tmp102_iic_alert_close,
+	.close = tmp102_iic_close,
+};
+
+tmp102_handle_t
+tmp102_open(const char *i2cdev, int addr)
+{
+	tmp102_handle_t h;
+	int fd;
+
+	fd = open(i2cdev, O_RDWR);
+	if (fd < 0)
+		return (TMP102_INVALID_HANDLE);
+
+	h = tmp102_alloc(&tmp102_iic_transport, fd, addr);
+	if (h == TMP102_INVALID_HANDLE)
+		close(fd);
+
+	return (h);
+}
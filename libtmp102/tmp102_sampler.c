@@ -0,0 +1,279 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tmp102.h"
+#include "tmp102_var.h"
+
+/*
+ * Continuous sampling: background thread reads the sensor on a fixed
+ * schedule and appends timestamped samples to a ring. There is only
+ * one writer, so readers never take a lock: they copy slots and then
+ * check how far the writer has moved meanwhile, dropping whatever it
+ * could have overwritten.
+ */
+
+/* Fields are atomic so that racing with the writer is well defined */
+struct tmp102_slot {
+	_Atomic int64_t	nsec;
+	atomic_int	temp;
+};
+
+struct tmp102_sampler {
+	pthread_t	thread;
+	/* Serializes bus access, also protects stop */
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int		stop;
+	uint64_t	period;		/* nanoseconds */
+	uint64_t	mask;
+	/* Number of samples ever written */
+	_Atomic uint64_t head;
+	struct tmp102_slot slots[];
+};
+
+void
+tmp102_sampler_lock(tmp102_handle_t h)
+{
+
+	pthread_mutex_lock(&h->sampler->lock);
+}
+
+void
+tmp102_sampler_unlock(tmp102_handle_t h)
+{
+
+	pthread_mutex_unlock(&h->sampler->lock);
+}
+
+static uint64_t
+timespec_to_nsec(const struct timespec *ts)
+{
+
+	return ((uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec);
+}
+
+static void
+nsec_to_timespec(uint64_t nsec, struct timespec *ts)
+{
+
+	ts->tv_sec = nsec / 1000000000;
+	ts->tv_nsec = nsec % 1000000000;
+}
+
+static void
+tmp102_sampler_push(struct tmp102_sampler *s, int64_t nsec, int temp)
+{
+	struct tmp102_slot *slot;
+	uint64_t head;
+
+	head = atomic_load_explicit(&s->head, memory_order_relaxed);
+	slot = &s->slots[head & s->mask];
+	/*
+	 * Reader that sees any of the stores below must also see head
+	 * published by the previous push, otherwise it would take the
+	 * slot for the older sample it's overwriting
+	 */
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&slot->nsec, nsec, memory_order_relaxed);
+	atomic_store_explicit(&slot->temp, temp, memory_order_relaxed);
+	atomic_store_explicit(&s->head, head + 1, memory_order_release);
+}
+
+static void *
+tmp102_sampler_thread(void *arg)
+{
+	struct tmp102_sampler *s;
+	struct timespec deadline, now;
+	tmp102_handle_t h;
+	uint64_t next, cur;
+	int temp;
+
+	h = arg;
+	s = h->sampler;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	pthread_mutex_lock(&s->lock);
+	while (!s->stop) {
+		if (tmp102_read_temp_locked(h, &temp) == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			tmp102_sampler_push(s, timespec_to_nsec(&now), temp);
+		}
+
+		/*
+		 * Deadlines are absolute so that read time doesn't skew the
+		 * schedule, periods missed on a slow bus are skipped rather
+		 * than sampled back to back
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		next = timespec_to_nsec(&deadline) + s->period;
+		cur = timespec_to_nsec(&now);
+		if (next <= cur)
+			next += ((cur - next) / s->period + 1) * s->period;
+		nsec_to_timespec(next, &deadline);
+
+		while (!s->stop &&
+		    (pthread_cond_timedwait(&s->cond, &s->lock,
+		    &deadline) != ETIMEDOUT))
+			;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return (NULL);
+}
+
+/*
+ * Start sampling every period_ms milliseconds, keeping at least the
+ * last depth samples
+ */
+int
+tmp102_sampler_start(tmp102_handle_t h, int period_ms, int depth)
+{
+	struct tmp102_sampler *s;
+	pthread_condattr_t attr;
+	int size;
+
+	if ((h == TMP102_INVALID_HANDLE) || (h->sampler != NULL))
+		return (-1);
+	if ((period_ms <= 0) || (depth <= 0) || (depth > TMP102_SAMPLER_MAX))
+		return (-1);
+
+	/* Slot the writer is about to reuse is not readable */
+	for (size = 2; size < depth + 1; size <<= 1)
+		;
+	s = calloc(1, sizeof(*s) + size * sizeof(s->slots[0]));
+	if (s == NULL)
+		return (-1);
+	s->mask = size - 1;
+	s->period = (uint64_t)period_ms * 1000000;
+	atomic_init(&s->head, 0);
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (pthread_cond_init(&s->cond, &attr)) {
+		pthread_condattr_destroy(&attr);
+		free(s);
+		return (-1);
+	}
+	pthread_condattr_destroy(&attr);
+	if (pthread_mutex_init(&s->lock, NULL)) {
+		pthread_cond_destroy(&s->cond);
+		free(s);
+		return (-1);
+	}
+
+	h->sampler = s;
+	if (pthread_create(&s->thread, NULL, tmp102_sampler_thread, h)) {
+		h->sampler = NULL;
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+		free(s);
+		return (-1);
+	}
+
+	return (0);
+}
+
+void
+tmp102_sampler_stop(tmp102_handle_t h)
+{
+	struct tmp102_sampler *s;
+
+	s = h->sampler;
+	if (s == NULL)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+
+	h->sampler = NULL;
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s);
+}
+
+/*
+ * Copy up to n most recent samples, oldest first. Returns number of
+ * samples copied.
+ */
+int
+tmp102_sample_history(tmp102_handle_t h, struct tmp102_sample *samples,
+    int n)
+{
+	struct tmp102_sampler *s;
+	struct tmp102_slot *slot;
+	uint64_t head, first, valid, skip;
+	int64_t nsec;
+	int i, count;
+
+	s = h->sampler;
+	if ((s == NULL) || (n <= 0))
+		return (0);
+
+	head = atomic_load_explicit(&s->head, memory_order_acquire);
+	count = n;
+	if ((uint64_t)count > head)
+		count = head;
+	if ((uint64_t)count > s->mask + 1)
+		count = s->mask + 1;
+	first = head - count;
+	for (i = 0; i < count; i++) {
+		slot = &s->slots[(first + i) & s->mask];
+		nsec = atomic_load_explicit(&slot->nsec, memory_order_relaxed);
+		samples[i].ts.tv_sec = nsec / 1000000000;
+		samples[i].ts.tv_nsec = nsec % 1000000000;
+		samples[i].temp = atomic_load_explicit(&slot->temp,
+		    memory_order_relaxed);
+	}
+
+	/* Slots of samples older than this could have been reused */
+	atomic_thread_fence(memory_order_acquire);
+	head = atomic_load_explicit(&s->head, memory_order_relaxed);
+	valid = (head > s->mask) ? head - s->mask : 0;
+	if (first >= valid)
+		return (count);
+	skip = valid - first;
+	if (skip > (uint64_t)count)
+		skip = count;
+	memmove(samples, samples + skip, (count - skip) * sizeof(samples[0]));
+
+	return (count - skip);
+}
+
+int
+tmp102_sample_latest(tmp102_handle_t h, struct tmp102_sample *sample)
+{
+
+	return (tmp102_sample_history(h, sample, 1) == 1 ? 0 : -1);
+}
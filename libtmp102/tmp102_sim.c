@@ -0,0 +1,339 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tmp102.h"
+#include "tmp102_var.h"
+
+/*
+ * Simulated sensor: decodes the same I2C messages the real part takes
+ * and runs its conversion and alert logic, including fault queue,
+ * polarity and both thermostat modes, so that everything above the
+ * bus, alert waits included, can be exercised without hardware.
+ * A conversion happens on every tmp102_sim_set_temp() call unless the
+ * sensor is shut down, and instantly on one-shot request.
+ */
+
+/* Power-on register values */
+#define	SIM_CONF_RESET	0x60a0
+#define	SIM_LOW_RESET	0x4b00		/* 75C */
+#define	SIM_HIGH_RESET	0x5000		/* 80C */
+
+struct tmp102_sim_softc {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	uint16_t	regs[4];
+	int		pointer;
+	int		temp;
+	/* Alert logic */
+	int		faults;
+	int		active;
+	/* Interrupt mode waits for low limit crossing after high one */
+	int		armed_low;
+	int		level;
+	/* Edges being watched and count of those that happened */
+	int		edges;
+	uint64_t	events;
+	uint64_t	seen;
+};
+
+static int
+tmp102_sim_level(struct tmp102_sim_softc *sc)
+{
+	int pol;
+
+	pol = (sc->regs[TMP102_REG_CONF] & TMP102_CONF_POL) ? 1 : 0;
+	return (sc->active ? pol : !pol);
+}
+
+/*
+ * Drive ALERT line from current alert state, waking up waiters if the
+ * edge is one they watch
+ */
+static void
+tmp102_sim_update(struct tmp102_sim_softc *sc)
+{
+	int level, edge;
+
+	level = tmp102_sim_level(sc);
+	if (level == sc->level)
+		return;
+	sc->level = level;
+	edge = level ? TMP102_EDGE_RISING : TMP102_EDGE_FALLING;
+	if (sc->edges & edge) {
+		sc->events++;
+		pthread_cond_broadcast(&sc->cond);
+	}
+}
+
+static void
+tmp102_sim_convert(struct tmp102_sim_softc *sc)
+{
+	static const int queue[] = { 1, 2, 4, 6 };
+	uint16_t conf;
+	int extended, low, high, hit;
+
+	conf = sc->regs[TMP102_REG_CONF];
+	extended = conf & TMP102_CONF_EM;
+	sc->regs[TMP102_REG_TEMP] = tmp102_temp_to_reg(sc->temp, extended) |
+	    (extended ? 1 : 0);
+
+	low = tmp102_reg_to_temp(sc->regs[TMP102_REG_TEMP_LOW], extended);
+	high = tmp102_reg_to_temp(sc->regs[TMP102_REG_TEMP_HIGH], extended);
+	if (conf & TMP102_CONF_TM)
+		hit = sc->armed_low ? (sc->temp < low) : (sc->temp >= high);
+	else
+		hit = sc->active ? (sc->temp < low) : (sc->temp >= high);
+	sc->faults = hit ? sc->faults + 1 : 0;
+	if (sc->faults >= queue[(conf & TMP102_CONF_F_MASK) >>
+	    TMP102_CONF_F_SHIFT]) {
+		sc->faults = 0;
+		if (conf & TMP102_CONF_TM) {
+			sc->active = 1;
+			sc->armed_low = !sc->armed_low;
+		} else
+			sc->active = !sc->active;
+	}
+	tmp102_sim_update(sc);
+}
+
+static void
+tmp102_sim_write(struct tmp102_sim_softc *sc, int reg, uint16_t val)
+{
+	uint16_t old;
+
+	if (reg != TMP102_REG_CONF) {
+		if (reg != TMP102_REG_TEMP)
+			sc->regs[reg] = val;
+		return;
+	}
+
+	old = sc->regs[TMP102_REG_CONF];
+	sc->regs[reg] = (val & ~(TMP102_CONF_OS | TMP102_CONF_AL |
+	    TMP102_CONF_R_MASK)) | TMP102_CONF_R_MASK;
+	/* Switching thermostat mode starts alert logic over */
+	if ((old ^ val) & TMP102_CONF_TM) {
+		sc->active = sc->armed_low = sc->faults = 0;
+		tmp102_sim_update(sc);
+	}
+	if ((old ^ val) & TMP102_CONF_POL)
+		tmp102_sim_update(sc);
+	if ((val & TMP102_CONF_SD) && (val & TMP102_CONF_OS))
+		tmp102_sim_convert(sc);
+}
+
+static uint16_t
+tmp102_sim_read(struct tmp102_sim_softc *sc, int reg)
+{
+	uint16_t val;
+
+	val = sc->regs[reg];
+	if (reg == TMP102_REG_CONF) {
+		if (sc->level)
+			val |= TMP102_CONF_AL;
+		/* One-shot conversion is over as soon as it starts */
+		if (val & TMP102_CONF_SD)
+			val |= TMP102_CONF_OS;
+	}
+
+	return (val);
+}
+
+static int
+tmp102_sim_transfer(tmp102_handle_t h, struct iic_msg *msgs, int nmsgs)
+{
+	struct tmp102_sim_softc *sc;
+	struct iic_msg *m;
+	uint16_t val;
+	int i, err;
+
+	sc = h->softc;
+	err = 0;
+	pthread_mutex_lock(&sc->lock);
+	for (i = 0; (i < nmsgs) && (err == 0); i++) {
+		m = &msgs[i];
+		/* Nobody else on this bus to acknowledge */
+		if (m->slave != h->addr) {
+			err = -1;
+			break;
+		}
+		if (m->flags & IIC_M_RD) {
+			val = tmp102_sim_read(sc, sc->pointer);
+			if (m->len > 0)
+				m->buf[0] = val >> 8;
+			if (m->len > 1)
+				m->buf[1] = val & 0xff;
+		} else if (m->len > 0) {
+			sc->pointer = m->buf[0] & 3;
+			if (m->len >= 3)
+				tmp102_sim_write(sc, sc->pointer,
+				    (m->buf[1] << 8) | m->buf[2]);
+		}
+		/* Any access releases the line in interrupt mode */
+		if (sc->regs[TMP102_REG_CONF] & TMP102_CONF_TM) {
+			sc->active = 0;
+			tmp102_sim_update(sc);
+		}
+	}
+	pthread_mutex_unlock(&sc->lock);
+
+	return (err);
+}
+
+static int
+tmp102_sim_alert_open(tmp102_handle_t h, int gpio_unit __unused,
+    int gpio_pin __unused, int edges)
+{
+	struct tmp102_sim_softc *sc;
+
+	sc = h->softc;
+	pthread_mutex_lock(&sc->lock);
+	sc->edges = edges;
+	sc->seen = sc->events;
+	pthread_mutex_unlock(&sc->lock);
+
+	return (0);
+}
+
+static int
+tmp102_sim_alert_wait(tmp102_handle_t h, int timeout_ms)
+{
+	struct tmp102_sim_softc *sc;
+	struct timespec deadline;
+	int err;
+
+	sc = h->softc;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	err = 0;
+	pthread_mutex_lock(&sc->lock);
+	while ((sc->events == sc->seen) && (err == 0)) {
+		if (timeout_ms < 0)
+			err = pthread_cond_wait(&sc->cond, &sc->lock);
+		else
+			err = pthread_cond_timedwait(&sc->cond, &sc->lock,
+			    &deadline);
+	}
+	/* Edges that piled up are reported as one */
+	err = (sc->events != sc->seen);
+	sc->seen = sc->events;
+	pthread_mutex_unlock(&sc->lock);
+
+	return (err);
+}
+
+static void
+tmp102_sim_alert_close(tmp102_handle_t h)
+{
+	struct tmp102_sim_softc *sc;
+
+	sc = h->softc;
+	pthread_mutex_lock(&sc->lock);
+	sc->edges = 0;
+	pthread_mutex_unlock(&sc->lock);
+}
+
+static void
+tmp102_sim_close(tmp102_handle_t h)
+{
+	struct tmp102_sim_softc *sc;
+
+	sc = h->softc;
+	pthread_mutex_destroy(&sc->lock);
+	pthread_cond_destroy(&sc->cond);
+	free(sc);
+}
+
+static const struct tmp102_transport tmp102_sim_transport = {
+	.name = "sim",
+	.transfer = tmp102_sim_transfer,
+	.alert_open = tmp102_sim_alert_open,
+	.alert_wait = tmp102_sim_alert_wait,
+	.alert_close = tmp102_sim_alert_close,
+	.close = tmp102_sim_close,
+};
+
+tmp102_handle_t
+tmp102_open_sim(int addr)
+{
+	struct tmp102_sim_softc *sc;
+	pthread_condattr_t attr;
+	tmp102_handle_t h;
+
+	sc = calloc(1, sizeof(*sc));
+	if (sc == NULL)
+		return (TMP102_INVALID_HANDLE);
+	pthread_mutex_init(&sc->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sc->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	sc->regs[TMP102_REG_CONF] = SIM_CONF_RESET & ~TMP102_CONF_AL;
+	sc->regs[TMP102_REG_TEMP_LOW] = SIM_LOW_RESET;
+	sc->regs[TMP102_REG_TEMP_HIGH] = SIM_HIGH_RESET;
+	sc->temp = 25000;
+	sc->level = tmp102_sim_level(sc);
+	tmp102_sim_convert(sc);
+
+	h = tmp102_alloc(&tmp102_sim_transport, -1, addr);
+	if (h == TMP102_INVALID_HANDLE) {
+		pthread_mutex_destroy(&sc->lock);
+		pthread_cond_destroy(&sc->cond);
+		free(sc);
+		return (TMP102_INVALID_HANDLE);
+	}
+	h->softc = sc;
+
+	return (h);
+}
+
+/*
+ * Set temperature the sensor sees and run one conversion cycle, unless
+ * it's shut down and waits for one-shot request
+ */
+void
+tmp102_sim_set_temp(tmp102_handle_t h, int temp)
+{
+	struct tmp102_sim_softc *sc;
+
+	sc = h->softc;
+	pthread_mutex_lock(&sc->lock);
+	sc->temp = temp;
+	if ((sc->regs[TMP102_REG_CONF] & TMP102_CONF_SD) == 0)
+		tmp102_sim_convert(sc);
+	pthread_mutex_unlock(&sc->lock);
+}
@@ -0,0 +1,110 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __TMP102_VAR_H__
+#define __TMP102_VAR_H__
+
+/* <sys/cdefs.h> provides it on FreeBSD only */
+#ifndef __unused
+#define	__unused	__attribute__((__unused__))
+#endif
+
+/*
+ * Messages are built in iicbus(4) layout. Elsewhere only the simulated
+ * sensor can take them, so a compatible definition is enough.
+ */
+#ifdef __FreeBSD__
+#include <dev/iicbus/iic.h>
+#else
+struct iic_msg {
+	uint16_t	slave;
+	uint16_t	flags;
+#define	IIC_M_WR	0
+#define	IIC_M_RD	1
+	uint16_t	len;
+	uint8_t		*buf;
+};
+#endif
+
+/* Registers read in one transaction at most */
+#define	TMP102_MAX_BATCH	4
+
+/* Alert line edges to wake up on */
+#define	TMP102_EDGE_FALLING	(1 << 0)
+#define	TMP102_EDGE_RISING	(1 << 1)
+
+/*
+ * Bus backend. Alert methods wait for edges of the sensor's ALERT
+ * output, alert_wait() returns 1 if there was one, 0 on timeout.
+ */
+struct tmp102_transport {
+	const char	*name;
+	int		(*transfer)(tmp102_handle_t h, struct iic_msg *msgs,
+			    int nmsgs);
+	int		(*alert_open)(tmp102_handle_t h, int gpio_unit,
+			    int gpio_pin, int edges);
+	int		(*alert_wait)(tmp102_handle_t h, int timeout_ms);
+	void		(*alert_close)(tmp102_handle_t h);
+	void		(*close)(tmp102_handle_t h);
+};
+
+extern const struct tmp102_transport tmp102_iic_transport;
+
+tmp102_handle_t tmp102_alloc(const struct tmp102_transport *ops, int fd,
+    int addr);
+void tmp102_conf_update(tmp102_handle_t h, uint16_t conf);
+int tmp102_conf_get(tmp102_handle_t h);
+int tmp102_transfer(tmp102_handle_t h, struct tmp102_stats *stats,
+    struct iic_msg *msgs, int nmsgs);
+void tmp102_stats_reads(struct tmp102_stats *stats,
+    const struct timespec *start, int n);
+int tmp102_read_msgs(tmp102_handle_t h, const uint8_t *regs, int n,
+    struct iic_msg *msgs, uint8_t (*bytes)[2]);
+void tmp102_read_done(tmp102_handle_t h, const uint8_t *regs, int n,
+    uint8_t (*bytes)[2], uint16_t *vals, int error);
+
+int tmp102_read_registers(tmp102_handle_t h, const uint8_t *regs,
+    uint16_t *vals, int n);
+
+/* Bus read for the sampler thread, which already holds the lock */
+int tmp102_read_temp_locked(tmp102_handle_t h, int *temp);
+
+/*
+ * Bus access is serialized only while sampler thread is running
+ */
+void tmp102_sampler_lock(tmp102_handle_t h);
+void tmp102_sampler_unlock(tmp102_handle_t h);
+
+#define	TMP102_LOCK(h)	do {					\
+	if ((h)->sampler != NULL)				\
+		tmp102_sampler_lock(h);				\
+} while (0)
+
+#define	TMP102_UNLOCK(h)	do {				\
+	if ((h)->sampler != NULL)				\
+		tmp102_sampler_unlock(h);			\
+} while (0)
+
+#endif /* __TMP102_VAR_H__ */
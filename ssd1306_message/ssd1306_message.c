@@ -40,7 +40,8 @@
 
 void usage(const char *prog)
 {
-	fprintf(stderr, "%s: [-irs] msg1 [msg2]\n", prog);
+	fprintf(stderr, "%s: [-irs] [-f font] msg1 [msg2]\n", prog);
+	fprintf(stderr, "\t-f font\t\tproportional font file\n");
 	fprintf(stderr, "\t-i\t\tinverse screen\n");
 	fprintf(stderr, "\t-r\t\trotate screen by 180\n");
 	fprintf(stderr, "\t-s\t\tskip initialization\n");
@@ -54,9 +55,11 @@ main(int argc, char **argv)
 	int flags;
 	int ch;
 	int width, height;
-	int font_width, font_height;
+	int font_height;
 	const char *prog;
-	int skip;
+	const char *font;
+	ssd1306_pfont_t pfont;
+	int skip, warm;
 	int x, y;
 
 	prog = argv[0];
@@ -64,8 +67,13 @@ main(int argc, char **argv)
 	msg1 = msg2 = NULL;
 	flags = 0;
 	skip = 0;
-	while ((ch = getopt(argc, argv, "irs")) != -1) {
+	font = NULL;
+	pfont = SSD1306_INVALID_PFONT;
+	while ((ch = getopt(argc, argv, "f:irs")) != -1) {
 		switch (ch) {
+		case 'f':
+			font = optarg;
+			break;
 		case 'i':
 			flags |= SSD1306_FLAG_INVERSE;
 			break;
@@ -95,21 +103,38 @@ main(int argc, char **argv)
 	if (argc > 1)
 		msg2 = argv[1];
 
-	ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
+	/* Panel is already set up if display daemon is running */
+	warm = 1;
+	ssd1306 = ssd1306_attach(SSD1306D_SOCKET);
 	if (ssd1306 == SSD1306_INVALID_HANDLE) {
-		fprintf(stderr, "failed to create SSD1306 handle\n");
-		return (1);
+		ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
+		if (ssd1306 == SSD1306_INVALID_HANDLE) {
+			fprintf(stderr, "failed to create SSD1306 handle\n");
+			return (1);
+		}
+
+		if (!skip)
+			warm = ssd1306_initialize_warm(ssd1306,
+			    SSD1306_STATE_FILE);
+		if (warm < 0) {
+			fprintf(stderr, "failed to initialize SSD1306\n");
+			ssd1306_close(ssd1306);
+			return (1);
+		}
 	}
 
-	if (!skip && ssd1306_initialize(ssd1306)) {
-		fprintf(stderr, "failed to initialize SSD1306\n");
-		ssd1306_close(ssd1306);
-		return (1);
+	if (font != NULL) {
+		pfont = ssd1306_pfont_load(font);
+		if (pfont == SSD1306_INVALID_PFONT) {
+			fprintf(stderr, "failed to load font %s\n", font);
+			ssd1306_close(ssd1306);
+			return (1);
+		}
+		ssd1306_set_pfont(ssd1306, pfont);
 	}
 
 	width = ssd1306_width(ssd1306);
 	height = ssd1306_height(ssd1306);
-	font_width = ssd1306_font_width(ssd1306);
 	font_height = ssd1306_font_height(ssd1306);
 
 	ssd1306_clear(ssd1306);
@@ -119,13 +144,13 @@ main(int argc, char **argv)
 	else
 		y = (height - font_height) / 2;
 	
-	x = (width - strlen(msg1) * font_width) / 2;
+	x = (width - ssd1306_measure(ssd1306, msg1)) / 2;
 
 	ssd1306_putstr(ssd1306, x, y, msg1);
 	
 	if (msg2) {
 		y += font_height;
-		x = (width - strlen(msg2) * font_width) / 2;
+		x = (width - ssd1306_measure(ssd1306, msg2)) / 2;
 		ssd1306_putstr(ssd1306, x, y, msg2);
 	}
 
@@ -133,5 +158,7 @@ main(int argc, char **argv)
 	ssd1306_on(ssd1306);
 
 	ssd1306_close(ssd1306);
+	if (pfont != SSD1306_INVALID_PFONT)
+		ssd1306_pfont_free(pfont);
 	return (0);
 }
@@ -54,11 +54,11 @@ main(int argc, char **argv)
 	int flags;
 	int ch;
 	int width, height;
-	int font_width, font_height;
+	int font_height;
 	const char *prog;
-	int skip;
-	int x, y, c;
-	int chars, percent, pos;
+	int skip, warm;
+	int x, y;
+	int percent, pos;
 
 	prog = argv[0];
 
@@ -94,37 +94,46 @@ main(int argc, char **argv)
 
 	msg = argv[0];
 
-	ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
+	/* Panel is already set up if display daemon is running */
+	warm = 1;
+	ssd1306 = ssd1306_attach(SSD1306D_SOCKET);
 	if (ssd1306 == SSD1306_INVALID_HANDLE) {
-		fprintf(stderr, "failed to create SSD1306 handle\n");
-		return (1);
-	}
-
-	if (!skip && ssd1306_initialize(ssd1306)) {
-		fprintf(stderr, "failed to initialize SSD1306\n");
-		ssd1306_close(ssd1306);
-		return (1);
+		ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
+		if (ssd1306 == SSD1306_INVALID_HANDLE) {
+			fprintf(stderr, "failed to create SSD1306 handle\n");
+			return (1);
+		}
+
+		if (!skip)
+			warm = ssd1306_initialize_warm(ssd1306,
+			    SSD1306_STATE_FILE);
+		if (warm < 0) {
+			fprintf(stderr, "failed to initialize SSD1306\n");
+			ssd1306_close(ssd1306);
+			return (1);
+		}
 	}
 
 	width = ssd1306_width(ssd1306);
 	height = ssd1306_height(ssd1306);
-	font_width = ssd1306_font_width(ssd1306);
 	font_height = ssd1306_font_height(ssd1306);
 
 	ssd1306_clear(ssd1306);
-	ssd1306_refresh(ssd1306);
+	/* Blank frame hides RAM content left by reset */
+	if (!warm)
+		ssd1306_refresh(ssd1306);
 	ssd1306_on(ssd1306);
 
 	y = (height - font_height * 2) / 2;
-	x = (width - strlen(msg) * font_width) / 2;
+	x = (width - ssd1306_measure(ssd1306, msg)) / 2;
 
-	chars = width / font_width;
+	/* Bar frame under the message, filled part grows inside of it */
+	ssd1306_rect(ssd1306, 0, y + font_height, width, font_height, 1);
 	for (percent = 0; percent <= 100; percent += 10) {
 		ssd1306_putstr(ssd1306, x, y, msg);
-		/* Position of rightmost "finished" char */
-		pos = percent * chars /100;
-		for (c = 0; c < chars; c++)
-			ssd1306_putchar(ssd1306, font_width * c, y + font_height, c <= pos ? 0xdb : 0xb0);
+		pos = percent * (width - 4) / 100;
+		ssd1306_fill_rect(ssd1306, 2, y + font_height + 2, pos,
+		    font_height - 4, 1);
 		ssd1306_refresh(ssd1306);
 		usleep(500000);
 	}
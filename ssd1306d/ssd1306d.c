@@ -0,0 +1,257 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <grp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ssd1306.h"
+
+/* My Raspberry Pi setup */
+#define	SPIDEV	"/dev/spigen0"
+#define	GPIOC	0
+#define	PIN_DC	23
+#define	PIN_RST	24
+#define	MODEL	SSD1306_MODEL_128X32
+
+#define	MAX_CLIENTS	16
+
+static volatile sig_atomic_t done;
+
+void usage(const char *prog)
+{
+	fprintf(stderr, "%s: [-irs] [-g group] [-M mode] [-m shm] [-p socket]\n",
+	    prog);
+	fprintf(stderr, "\t-i\t\tinverse screen\n");
+	fprintf(stderr, "\t-r\t\trotate screen by 180\n");
+	fprintf(stderr, "\t-s\t\tskip initialization\n");
+	fprintf(stderr, "\t-g group\tgroup allowed to draw (default own)\n");
+	fprintf(stderr, "\t-M mode\t\tsocket and shared memory access mode "
+	    "(default %04o)\n", SSD1306D_MODE);
+	fprintf(stderr, "\t-m shm\t\tshared memory object (default %s)\n",
+	    SSD1306D_SHM);
+	fprintf(stderr, "\t-p socket\tUnix socket path (default %s)\n",
+	    SSD1306D_SOCKET);
+}
+
+static void
+terminate(int sig)
+{
+
+	done = 1;
+}
+
+static int
+listen_socket(const char *path, mode_t mode, gid_t gid)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlcpy(sun.sun_path, path, sizeof(sun.sun_path)) >=
+	    sizeof(sun.sun_path))
+		return (-1);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return (-1);
+	/* Left over from previous run */
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+		close(fd);
+		return (-1);
+	}
+	/* Nobody can connect before listen(), set permissions first */
+	if ((chmod(path, mode) < 0) ||
+	    ((gid != (gid_t)-1) && (chown(path, (uid_t)-1, gid) < 0)) ||
+	    (listen(fd, MAX_CLIENTS) < 0)) {
+		close(fd);
+		unlink(path);
+		return (-1);
+	}
+
+	return (fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	ssd1306_handle_t ssd1306;
+	struct pollfd fds[MAX_CLIENTS + 1];
+	const char *prog, *shm, *path;
+	struct group *gr;
+	char *end;
+	mode_t mode;
+	gid_t gid;
+	int flags;
+	int ch, i, n, nfds, fd;
+	int skip, warm;
+
+	prog = argv[0];
+
+	flags = 0;
+	skip = 0;
+	shm = SSD1306D_SHM;
+	path = SSD1306D_SOCKET;
+	mode = SSD1306D_MODE;
+	gid = (gid_t)-1;
+	while ((ch = getopt(argc, argv, "g:iM:m:p:rs")) != -1) {
+		switch (ch) {
+		case 'g':
+			gr = getgrnam(optarg);
+			if (gr != NULL)
+				gid = gr->gr_gid;
+			else {
+				gid = strtoul(optarg, &end, 10);
+				if ((*optarg == '\0') || (*end != '\0')) {
+					fprintf(stderr, "unknown group %s\n",
+					    optarg);
+					return (1);
+				}
+			}
+			break;
+		case 'i':
+			flags |= SSD1306_FLAG_INVERSE;
+			break;
+		case 'M':
+			mode = strtoul(optarg, &end, 8);
+			if ((*optarg == '\0') || (*end != '\0') ||
+			    (mode & ~0777)) {
+				usage(prog);
+				return (1);
+			}
+			break;
+		case 'm':
+			shm = optarg;
+			break;
+		case 'p':
+			path = optarg;
+			break;
+		case 'r':
+			flags |= SSD1306_FLAG_ROTATE;
+			break;
+		case 's':
+			skip = 1;
+			break;
+
+		case '?':
+		default:
+			usage(prog);
+			return (1);
+	     }
+	}
+
+	ssd1306 = ssd1306_open(SPIDEV, MODEL, GPIOC, PIN_RST, GPIOC, PIN_DC, flags);
+	if (ssd1306 == SSD1306_INVALID_HANDLE) {
+		fprintf(stderr, "failed to create SSD1306 handle\n");
+		return (1);
+	}
+
+	warm = 1;
+	if (!skip)
+		warm = ssd1306_initialize_warm(ssd1306, SSD1306_STATE_FILE);
+	if (warm < 0) {
+		fprintf(stderr, "failed to initialize SSD1306\n");
+		ssd1306_close(ssd1306);
+		return (1);
+	}
+
+	ssd1306_clear(ssd1306);
+	/* Blank frame hides RAM content left by reset */
+	if (!warm)
+		ssd1306_refresh(ssd1306);
+	ssd1306_on(ssd1306);
+
+	if (ssd1306_shm_create(ssd1306, shm, mode, gid)) {
+		fprintf(stderr, "failed to create shared memory %s\n", shm);
+		ssd1306_close(ssd1306);
+		return (1);
+	}
+
+	fds[0].fd = listen_socket(path, mode, gid);
+	if (fds[0].fd < 0) {
+		fprintf(stderr, "failed to listen on %s\n", path);
+		ssd1306_close(ssd1306);
+		return (1);
+	}
+	fds[0].events = POLLIN;
+	nfds = 1;
+
+	signal(SIGINT, terminate);
+	signal(SIGTERM, terminate);
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!done) {
+		n = poll(fds, nfds, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		/* Requests from connected clients */
+		for (i = 1; i < nfds; i++) {
+			if (fds[i].revents == 0)
+				continue;
+			if ((fds[i].revents & POLLIN) &&
+			    (ssd1306_shm_serve(ssd1306, fds[i].fd) == 0))
+				continue;
+			close(fds[i].fd);
+			fds[i--] = fds[--nfds];
+		}
+
+		if (fds[0].revents & POLLIN) {
+			fd = accept(fds[0].fd, NULL, NULL);
+			if (fd < 0)
+				continue;
+			if ((nfds > MAX_CLIENTS) ||
+			    ssd1306_shm_accept(ssd1306, fd)) {
+				close(fd);
+				continue;
+			}
+			fds[nfds].fd = fd;
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			nfds++;
+		}
+	}
+
+	for (i = 1; i < nfds; i++)
+		close(fds[i].fd);
+	close(fds[0].fd);
+	unlink(path);
+	ssd1306_close(ssd1306);
+
+	return (0);
+}
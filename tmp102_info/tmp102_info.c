@@ -29,14 +29,107 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 #include "tmp102.h"
 
 void usage(const char *prog)
 {
-	fprintf(stderr, "%s: [-f /dev/iicN] [-a addr]\n", prog);
+	fprintf(stderr, "%s: [-f /dev/iicN] [-a addr [-o] | -g]\n", prog);
+	fprintf(stderr, "%s: [-f /dev/iicN] [-a addr] -w unit:pin -l low -h high\n",
+	    prog);
 	fprintf(stderr, "\t-a addr\t\tTMP102 address (default 0x48)\n");
 	fprintf(stderr, "\t-f /dev/iicN\t\tI2C bus (default iic0)\n");
 	fprintf(stderr, "\t-F\t\tshow temperature in Fahreheits\n");
+	fprintf(stderr, "\t-g\t\tread all TMP102s found on the bus\n");
+	fprintf(stderr, "\t-h high\t\talert threshold, Celsius\n");
+	fprintf(stderr, "\t-l low\t\talert release threshold, Celsius\n");
+	fprintf(stderr, "\t-o\t\tone-shot conversion, leave sensor shut down\n");
+	fprintf(stderr, "\t-w unit:pin\twatch ALERT line on gpioc unit pin\n");
+}
+
+static void
+print_temp(const char *prefix, int temp, int fahrenheit)
+{
+	char scale;
+
+	if (fahrenheit) {
+		scale = 'F';
+		temp = temp * 9 / 5 + 32000;
+	}
+	else
+		scale = 'C';
+
+	printf("%sTemperature is %.1f %c\n", prefix, temp/1000., scale);
+}
+
+static int
+group_info(const char *i2c, int fahrenheit)
+{
+	tmp102_group_t group;
+	int temps[TMP102_GROUP_MAX];
+	char prefix[16];
+	int i;
+
+	group = tmp102_group_open(i2c);
+	if (group == TMP102_INVALID_GROUP) {
+		fprintf(stderr, "No TMP102 found on %s\n", i2c);
+		return (1);
+	}
+
+	if (tmp102_group_read_temp(group, temps)) {
+		fprintf(stderr, "Failed to read tempreture from TMP102s\n");
+		tmp102_group_close(group);
+		return (1);
+	}
+
+	for (i = 0; i < tmp102_group_count(group); i++) {
+		snprintf(prefix, sizeof(prefix), "0x%02x: ",
+		    tmp102_group_addr(group, i));
+		print_temp(prefix, temps[i], fahrenheit);
+	}
+
+	tmp102_group_close(group);
+	return (0);
+}
+
+/*
+ * Sleep on ALERT line and report every time temperature goes over
+ * high limit or drops back under low one
+ */
+static int
+alert_watch(tmp102_handle_t tmp102, const char *gpio, int low, int high,
+    int fahrenheit)
+{
+	struct tmp102_alert alert;
+	char *end;
+	int unit, pin;
+
+	unit = strtol(gpio, &end, 0);
+	if ((end == gpio) || (*end != ':')) {
+		fprintf(stderr, "GPIO should be specified as unit:pin\n");
+		return (1);
+	}
+	pin = strtol(end + 1, NULL, 0);
+
+	if (tmp102_set_limits(tmp102, low, high)) {
+		fprintf(stderr, "Failed to set TMP102 limits\n");
+		return (1);
+	}
+
+	if (tmp102_alert_open(tmp102, unit, pin)) {
+		fprintf(stderr, "Failed to open ALERT pin %s\n", gpio);
+		return (1);
+	}
+
+	for (;;) {
+		if (tmp102_alert_wait(tmp102, -1, &alert) < 0) {
+			fprintf(stderr, "Failed to wait for TMP102 alert\n");
+			return (1);
+		}
+		print_temp(alert.active ? "ALERT: " : "Clear: ", alert.temp,
+		    fahrenheit);
+		fflush(stdout);
+	}
 }
 
 int
@@ -47,15 +140,19 @@ main(int argc, char **argv)
 	const char *i2c;
 	int addr;
 	int fahrenheit = 0;
-	char scale;
+	int group = 0;
+	int oneshot = 0;
 	int temp;
+	const char *gpio = NULL;
+	int low = INT_MIN, high = INT_MIN;
+	int ret;
 	tmp102_handle_t tmp102;
 
 	prog = argv[0];
 	i2c = "/dev/iic0";
 	addr = TMP102_DEFAULT_ADDR;
 
-	while ((ch = getopt(argc, argv, "a:f:F")) != -1) {
+	while ((ch = getopt(argc, argv, "a:f:Fgh:l:ow:")) != -1) {
 		switch (ch) {
 		case 'f':
 			i2c = optarg;
@@ -66,6 +163,21 @@ main(int argc, char **argv)
 		case 'F':
 			fahrenheit = 1;
 			break;
+		case 'g':
+			group = 1;
+			break;
+		case 'h':
+			high = strtod(optarg, NULL) * 1000;
+			break;
+		case 'l':
+			low = strtod(optarg, NULL) * 1000;
+			break;
+		case 'o':
+			oneshot = 1;
+			break;
+		case 'w':
+			gpio = optarg;
+			break;
 
 		case '?':
 		default:
@@ -77,26 +189,34 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	if (group)
+		return (group_info(i2c, fahrenheit));
+
+	if ((gpio != NULL) && ((low == INT_MIN) || (high == INT_MIN))) {
+		usage(prog);
+		return (1);
+	}
+
 	tmp102 = tmp102_open(i2c, addr);
 	if (tmp102 == TMP102_INVALID_HANDLE) {
 		fprintf(stderr, "Failed to open TMP102\n");
 		return (1);
 	}
 
-	if (tmp102_read_temp(tmp102, &temp)) {
-		fprintf(stderr, "Failed to read tempreture from TMP102\n");
+	if (gpio != NULL) {
+		ret = alert_watch(tmp102, gpio, low, high, fahrenheit);
 		tmp102_close(tmp102);
-		return (1);
+		return (ret);
 	}
 
-	if (fahrenheit) {
-		scale = 'F';
-		temp = temp * 9 / 5 + 32;
+	if ((oneshot ? tmp102_oneshot_read(tmp102, &temp) :
+	    tmp102_read_temp(tmp102, &temp))) {
+		fprintf(stderr, "Failed to read tempreture from TMP102\n");
+		tmp102_close(tmp102);
+		return (1);
 	}
-	else
-		scale = 'C';
 
-	printf("Temperature is %.1f %c\n", temp/1000., scale);
+	print_temp("", temp, fahrenheit);
 
 	tmp102_close(tmp102);
 	return (0);
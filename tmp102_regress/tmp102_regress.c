@@ -0,0 +1,187 @@
+/*-
+ * Copyright (c) 2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Regression run of the alert, limit and one-shot logic against the
+ * simulated sensor, so it works on any host without I2C hardware.
+ * Prints one line per check and exits with non-zero status if any of
+ * them failed.
+ */
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "tmp102.h"
+
+static int failures;
+
+static void
+check(const char *name, int ok)
+{
+
+	printf("%s\t%s\n", ok ? "ok" : "FAIL", name);
+	if (!ok)
+		failures++;
+}
+
+/* Feed the same temperature to n conversion cycles */
+static void
+convert(tmp102_handle_t h, int temp, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		tmp102_sim_set_temp(h, temp);
+}
+
+static void
+test_limits(tmp102_handle_t h)
+{
+	int temp, low, high;
+
+	check("read temperature",
+	    tmp102_read_temp(h, &temp) == 0 && temp == 25000);
+	check("power-on limits", tmp102_get_limits(h, &low, &high) == 0 &&
+	    low == 75000 && high == 80000);
+	check("set limits", tmp102_set_limits(h, 30000, 40000) == 0);
+	check("read back limits", tmp102_get_limits(h, &low, &high) == 0 &&
+	    low == 30000 && high == 40000);
+	check("reject low above high", tmp102_set_limits(h, 50000, 40000) < 0);
+}
+
+/* Line follows temperature with hysteresis between the limits */
+static void
+test_comparator(tmp102_handle_t h)
+{
+	struct tmp102_alert alert;
+
+	check("comparator: open alert", tmp102_alert_open(h, 0, 0) == 0);
+	check("comparator: no alert below limits",
+	    tmp102_alert_wait(h, 20, &alert) == 0);
+	convert(h, 45000, 1);
+	check("comparator: alert above high",
+	    tmp102_alert_wait(h, 20, &alert) == 1 && alert.active &&
+	    alert.temp == 45000);
+	convert(h, 35000, 1);
+	check("comparator: held between limits",
+	    tmp102_alert_wait(h, 20, &alert) == 0);
+	convert(h, 25000, 1);
+	check("comparator: clear below low",
+	    tmp102_alert_wait(h, 20, &alert) == 1 && !alert.active);
+	tmp102_alert_close(h);
+}
+
+static void *
+heat_up(void *arg)
+{
+	tmp102_handle_t h;
+
+	h = arg;
+	usleep(50000);
+	tmp102_sim_set_temp(h, 90000);
+
+	return (NULL);
+}
+
+/* Every limit crossing is an event, fault queue delays it */
+static void
+test_interrupt(tmp102_handle_t h)
+{
+	struct tmp102_config cfg;
+	struct tmp102_alert alert;
+	pthread_t thread;
+
+	check("interrupt: get config", tmp102_get_config(h, &cfg) == 0);
+	cfg.interrupt = 1;
+	cfg.polarity = 1;
+	cfg.faults = TMP102_FAULTS_4;
+	check("interrupt: set config", tmp102_set_config(h, &cfg) == 0);
+	check("interrupt: open alert", tmp102_alert_open(h, 0, 0) == 0);
+
+	convert(h, 45000, 3);
+	check("interrupt: three faults are not enough",
+	    tmp102_alert_wait(h, 20, &alert) == 0);
+	convert(h, 45000, 1);
+	check("interrupt: alert on fourth fault",
+	    tmp102_alert_wait(h, 20, &alert) == 1 && alert.active);
+	convert(h, 45000, 4);
+	check("interrupt: no repeat above high",
+	    tmp102_alert_wait(h, 20, &alert) == 0);
+	convert(h, 20000, 4);
+	check("interrupt: alert on low crossing",
+	    tmp102_alert_wait(h, 20, &alert) == 1 && alert.temp == 20000);
+
+	convert(h, 90000, 3);
+	if (pthread_create(&thread, NULL, heat_up, h) != 0) {
+		check("interrupt: start thread", 0);
+		tmp102_alert_close(h);
+		return;
+	}
+	check("interrupt: blocking wait",
+	    tmp102_alert_wait(h, -1, &alert) == 1 && alert.temp == 90000);
+	pthread_join(thread, NULL);
+	tmp102_alert_close(h);
+}
+
+/* Shut down sensor converts only on request */
+static void
+test_oneshot(tmp102_handle_t h)
+{
+	struct tmp102_config cfg;
+	int temp;
+
+	check("one-shot: get config", tmp102_get_config(h, &cfg) == 0);
+	cfg.shutdown = 1;
+	check("one-shot: shut down", tmp102_set_config(h, &cfg) == 0);
+	convert(h, 33000, 1);
+	check("one-shot: conversion",
+	    tmp102_oneshot_read(h, &temp) == 0 && temp == 33000);
+	convert(h, 41000, 1);
+	check("one-shot: plain read converts too",
+	    tmp102_read_temp(h, &temp) == 0 && temp == 41000);
+}
+
+int
+main(void)
+{
+	tmp102_handle_t h;
+
+	h = tmp102_open_sim(TMP102_DEFAULT_ADDR);
+	if (h == TMP102_INVALID_HANDLE) {
+		fprintf(stderr, "Failed to create simulated TMP102\n");
+		return (1);
+	}
+
+	test_limits(h);
+	test_comparator(h);
+	test_interrupt(h);
+	test_oneshot(h);
+	tmp102_close(h);
+
+	printf("%d check(s) failed\n", failures);
+	return (failures != 0);
+}